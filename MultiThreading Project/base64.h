@@ -0,0 +1,431 @@
+// base64.h — Base64 codec with SIMD kernels picked once at startup
+// x86: SSE4.1, AVX2 and AVX-512 VBMI, chosen by CPUID; AArch64: NEON.
+// Each kernel converts whole blocks and hands the tail (and any block it
+// cannot validate) to the scalar code, so results match the scalar codec
+// byte for byte. B64_KERNEL=scalar|sse41|avx2|avx512vbmi|neon overrides the
+// choice, e.g. for benchmarking.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define B64_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define B64_TARGET(t)
+#else
+#define B64_TARGET(t) __attribute__((target(t)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define B64_NEON 1
+#include <arm_neon.h>
+#endif
+
+// ----- Scalar -----
+static constexpr char B64[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Char -> sextet; 255 = not Base64, 254 = '=' padding. Built at compile time.
+struct B64RevTable {
+    unsigned char v[256];
+    constexpr B64RevTable() : v{} {
+        for(int i=0;i<256;++i) v[i]=255;
+        for(int i=0;i<64;++i) v[(unsigned char)B64[i]]=(unsigned char)i;
+        v[(unsigned char)'=']=254;
+    }
+    constexpr unsigned char operator[](unsigned char c) const { return v[c]; }
+};
+static constexpr B64RevTable REV{};
+
+// Encodes d[0..n) into out (4*ceil(n/3) chars).
+static inline void b64_encode_scalar(const unsigned char* d, size_t n, char* out){
+    for(size_t i=0;i<n;i+=3){
+        unsigned int v = d[i]<<16;
+        if(i+1<n) v |= d[i+1]<<8;
+        if(i+2<n) v |= d[i+2];
+        *out++ = B64[(v>>18)&63];
+        *out++ = B64[(v>>12)&63];
+        *out++ = i+1<n ? B64[(v>>6)&63] : '=';
+        *out++ = i+2<n ? B64[v&63]     : '=';
+    }
+}
+
+// Decodes in[0..n) (n%4==0) into out; returns bytes written, or -1 if invalid.
+static inline long b64_decode_scalar(const char* in, size_t n, char* out){
+    char* o=out;
+    for(size_t i=0;i<n; i+=4){
+        int c0=REV[(unsigned char)in[i]];
+        int c1=REV[(unsigned char)in[i+1]];
+        int c2=REV[(unsigned char)in[i+2]];
+        int c3=REV[(unsigned char)in[i+3]];
+        if(c0==255 || c1==255 || c2==255 || c3==255) return -1;
+        unsigned int v = ((unsigned int)c0<<18) | ((unsigned int)c1<<12);
+        *o++ = (char)((v>>16)&0xFF);
+        if(c2!=254){
+            v |= (unsigned int)c2<<6;
+            *o++ = (char)((v>>8)&0xFF);
+            if(c3!=254){
+                v |= (unsigned int)c3;
+                *o++ = (char)(v&0xFF);
+            }
+        }
+    }
+    return (long)(o-out);
+}
+
+// ----- SIMD kernels -----
+// encode(d, n, out): converts as many whole blocks as fit, returns input
+// bytes consumed (a multiple of 3; output written = consumed/3*4).
+// decode(in, n, out): same for input chars (a multiple of 4, output
+// consumed/4*3); stops before the first block holding anything other than
+// the 64 alphabet chars, so padding and errors are left to the scalar code.
+// Both may store up to 16 bytes beyond what they report, but never past
+// what the caller's full-size output holds.
+struct B64Kernel {
+    const char* name;
+    size_t (*encode)(const unsigned char*, size_t, char*);
+    size_t (*decode)(const char*, size_t, char*);
+};
+
+#ifdef B64_X86
+
+B64_TARGET("sse4.1")
+static inline __m128i b64_sse_enc_lookup(__m128i idx){
+    // 0..25 -> 'A', 26..51 -> 'a', 52..61 -> '0', 62 -> '+', 63 -> '/'
+    const __m128i shift_lut = _mm_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+                                            '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62,
+                                            '/'-63, 'A', 0, 0);
+    __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+    r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, r), idx);
+}
+
+B64_TARGET("sse4.1")
+static size_t b64_encode_sse41(const unsigned char* d, size_t n, char* out){
+    size_t i=0;
+    // Loads 16 bytes, uses 12.
+    for(; i+16<=n; i+=12, out+=16){
+        __m128i in = _mm_loadu_si128((const __m128i*)(d+i));
+        in = _mm_shuffle_epi8(in, _mm_set_epi8(10,11,9,10, 7,8,6,7, 4,5,3,4, 1,2,0,1));
+        __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        _mm_storeu_si128((__m128i*)out, b64_sse_enc_lookup(_mm_or_si128(t0, t1)));
+    }
+    return i;
+}
+
+// Sextet values for 16 chars; `bad` gets a nonzero mask for non-alphabet chars.
+B64_TARGET("sse4.1")
+static inline __m128i b64_sse_dec_lookup(__m128i in, int& bad){
+    const __m128i shift_lut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_lut = _mm_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                           (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                           (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i bitpos_lut = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+    __m128i sh = _mm_shuffle_epi8(shift_lut, hi);
+    __m128i shift = _mm_blendv_epi8(sh, _mm_set1_epi8(16), _mm_cmpeq_epi8(in, _mm_set1_epi8('/')));
+    __m128i m = _mm_shuffle_epi8(mask_lut, lo);
+    __m128i bit = _mm_shuffle_epi8(bitpos_lut, hi);
+    bad = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(m, bit), _mm_setzero_si128()));
+    return _mm_add_epi8(in, shift);
+}
+
+B64_TARGET("sse4.1")
+static inline __m128i b64_sse_dec_pack(__m128i v){
+    __m128i ab_bc = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    __m128i abc = _mm_madd_epi16(ab_bc, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(abc, _mm_setr_epi8(2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1));
+}
+
+B64_TARGET("sse4.1")
+static size_t b64_decode_sse41(const char* in, size_t n, char* out){
+    size_t i=0;
+    // Stores 16 bytes, keeps 12; the 8 chars of lookahead guarantee room.
+    for(; i+24<=n; i+=16, out+=12){
+        int bad;
+        __m128i v = b64_sse_dec_lookup(_mm_loadu_si128((const __m128i*)(in+i)), bad);
+        if(bad) break;
+        _mm_storeu_si128((__m128i*)out, b64_sse_dec_pack(v));
+    }
+    return i;
+}
+
+B64_TARGET("avx2")
+static size_t b64_encode_avx2(const unsigned char* d, size_t n, char* out){
+    const __m256i shuf = _mm256_setr_epi8(1,0,2,1, 4,3,5,4, 7,6,8,7, 10,9,11,10,
+                                          1,0,2,1, 4,3,5,4, 7,6,8,7, 10,9,11,10);
+    const __m256i shift_lut = _mm256_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+                                               '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62,
+                                               '/'-63, 'A', 0, 0,
+                                               'a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+                                               '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62,
+                                               '/'-63, 'A', 0, 0);
+    size_t i=0;
+    // Each lane takes 12 bytes from its own 16-byte load.
+    for(; i+28<=n; i+=24, out+=32){
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(d+i))),
+                                             _mm_loadu_si128((const __m128i*)(d+i+12)), 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(t0, t1);
+        __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+        r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*)out, _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, r), idx));
+    }
+    return i;
+}
+
+B64_TARGET("avx2")
+static size_t b64_decode_avx2(const char* in, size_t n, char* out){
+    const __m256i shift_lut = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                               0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_lut = _mm256_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                              (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                              (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+                                              (char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                              (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                              (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m256i bitpos_lut = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+                                                0, 0, 0, 0, 0, 0, 0, 0,
+                                                0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+                                                0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1,
+                                          2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1);
+    size_t i=0;
+    // Stores 32 bytes, keeps 24; 16 chars of lookahead guarantee room.
+    for(; i+48<=n; i+=32, out+=24){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in+i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+        __m256i lo = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+        __m256i sh = _mm256_shuffle_epi8(shift_lut, hi);
+        __m256i shift = _mm256_blendv_epi8(sh, _mm256_set1_epi8(16), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+        __m256i m = _mm256_shuffle_epi8(mask_lut, lo);
+        __m256i bit = _mm256_shuffle_epi8(bitpos_lut, hi);
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(m, bit), _mm256_setzero_si256()))) break;
+        v = _mm256_add_epi8(v, shift);
+        __m256i ab_bc = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        __m256i abc = _mm256_madd_epi16(ab_bc, _mm256_set1_epi32(0x00011000));
+        abc = _mm256_shuffle_epi8(abc, pack);
+        // 12 bytes at the bottom of each lane -> 24 contiguous bytes.
+        abc = _mm256_permutevar8x32_epi32(abc, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256((__m256i*)out, abc);
+    }
+    return i;
+}
+
+// Lookup tables for the VBMI kernels, built from the scalar alphabet.
+struct B64VbmiTables {
+    alignas(64) unsigned char enc_shuf[64];     // 48 input bytes -> 16 dwords of [b1,b0,b2,b1]
+    alignas(64) unsigned char dec_lut[128];     // ASCII -> sextet, 0x80 if invalid
+    alignas(64) unsigned char dec_pack[64];     // 16 dwords of 3 bytes -> 48 contiguous bytes
+    alignas(64) char alphabet[64];
+    B64VbmiTables(){
+        for(int g=0; g<16; ++g){
+            enc_shuf[4*g+0]=(unsigned char)(3*g+1);
+            enc_shuf[4*g+1]=(unsigned char)(3*g);
+            enc_shuf[4*g+2]=(unsigned char)(3*g+2);
+            enc_shuf[4*g+3]=(unsigned char)(3*g+1);
+        }
+        memset(dec_lut, 0x80, sizeof(dec_lut));
+        for(int i=0;i<64;++i){ dec_lut[(unsigned char)B64[i]]=(unsigned char)i; alphabet[i]=B64[i]; }
+        for(int j=0;j<48;++j) dec_pack[j]=(unsigned char)(4*(j/3) + 2 - j%3);
+        memset(dec_pack+48, 0, 16);
+    }
+};
+static const B64VbmiTables b64_vbmi_tables;
+
+B64_TARGET("avx512f,avx512bw,avx512vbmi")
+static size_t b64_encode_avx512vbmi(const unsigned char* d, size_t n, char* out){
+    const B64VbmiTables& t = b64_vbmi_tables;
+    const __m512i shuf = _mm512_load_si512((const void*)t.enc_shuf);
+    const __m512i lut = _mm512_load_si512((const void*)t.alphabet);
+    // Per 64-bit lane: bit offsets of the four sextets of each [b1,b0,b2,b1] dword.
+    const __m512i shifts = _mm512_set1_epi64(0x3036242a1016040aLL);
+    size_t i=0;
+    // Loads 64 bytes, uses 48.
+    for(; i+64<=n; i+=48, out+=64){
+        __m512i in = _mm512_maskz_permutexvar_epi8(~0ULL, shuf, _mm512_loadu_si512((const void*)(d+i)));
+        __m512i idx = _mm512_maskz_multishift_epi64_epi8(~0ULL, shifts, in);
+        _mm512_storeu_si512((void*)out, _mm512_maskz_permutexvar_epi8(~0ULL, idx, lut));
+    }
+    return i;
+}
+
+B64_TARGET("avx512f,avx512bw,avx512vbmi")
+static size_t b64_decode_avx512vbmi(const char* in, size_t n, char* out){
+    const B64VbmiTables& t = b64_vbmi_tables;
+    const __m512i lut0 = _mm512_load_si512((const void*)t.dec_lut);
+    const __m512i lut1 = _mm512_load_si512((const void*)(t.dec_lut + 64));
+    const __m512i pack = _mm512_load_si512((const void*)t.dec_pack);
+    size_t i=0;
+    // Stores 64 bytes, keeps 48; 24 chars of lookahead guarantee room.
+    for(; i+88<=n; i+=64, out+=48){
+        __m512i v = _mm512_loadu_si512((const void*)(in+i));
+        __m512i s = _mm512_permutex2var_epi8(lut0, v, lut1);
+        // Bit 7 is set for non-ASCII input and for invalid table entries.
+        if(_mm512_movepi8_mask(_mm512_or_si512(s, v))) break;
+        __m512i ab_bc = _mm512_maddubs_epi16(s, _mm512_set1_epi32(0x01400140));
+        __m512i abc = _mm512_madd_epi16(ab_bc, _mm512_set1_epi32(0x00011000));
+        _mm512_storeu_si512((void*)out, _mm512_maskz_permutexvar_epi8(~0ULL, pack, abc));
+    }
+    return i;
+}
+
+static inline void b64_cpuid(int leaf, int sub, unsigned r[4]){
+#ifdef _MSC_VER
+    int x[4]; __cpuidex(x, leaf, sub);
+    for(int i=0;i<4;++i) r[i]=(unsigned)x[i];
+#else
+    __asm__ __volatile__("cpuid" : "=a"(r[0]), "=b"(r[1]), "=c"(r[2]), "=d"(r[3]) : "a"(leaf), "c"(sub));
+#endif
+}
+
+static inline unsigned long long b64_xgetbv(){
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi<<32) | lo;
+#endif
+}
+
+#endif // B64_X86
+
+#ifdef B64_NEON
+
+static const uint8_t b64_neon_dec_lut[128] = {
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255, 62,255,255,255, 63,
+     52, 53, 54, 55, 56, 57, 58, 59, 60, 61,255,255,255,255,255,255,
+    255,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+     15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,255,255,255,255,255,
+    255, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+     41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,255,255,255,255,255,
+};
+
+static size_t b64_encode_neon(const unsigned char* d, size_t n, char* out){
+    const uint8x16x4_t lut = vld1q_u8_x4((const uint8_t*)B64);
+    const uint8x16_t m6 = vdupq_n_u8(0x3f);
+    size_t i=0;
+    for(; i+48<=n; i+=48, out+=64){
+        uint8x16x3_t in = vld3q_u8(d+i);
+        uint8x16x4_t r;
+        r.val[0] = vshrq_n_u8(in.val[0], 2);
+        r.val[1] = vandq_u8(vorrq_u8(vshrq_n_u8(in.val[1], 4), vshlq_n_u8(in.val[0], 4)), m6);
+        r.val[2] = vandq_u8(vorrq_u8(vshrq_n_u8(in.val[2], 6), vshlq_n_u8(in.val[1], 2)), m6);
+        r.val[3] = vandq_u8(in.val[2], m6);
+        for(int k=0;k<4;++k) r.val[k] = vqtbl4q_u8(lut, r.val[k]);
+        vst4q_u8((uint8_t*)out, r);
+    }
+    return i;
+}
+
+static size_t b64_decode_neon(const char* in, size_t n, char* out){
+    const uint8x16x4_t lut0 = vld1q_u8_x4(b64_neon_dec_lut);
+    const uint8x16x4_t lut1 = vld1q_u8_x4(b64_neon_dec_lut + 64);
+    const uint8x16_t k64 = vdupq_n_u8(64);
+    size_t i=0;
+    for(; i+64<=n; i+=64, out+=48){
+        uint8x16x4_t v = vld4q_u8((const uint8_t*)(in+i));
+        uint8x16_t err = vdupq_n_u8(0);
+        for(int k=0;k<4;++k){
+            // Out-of-range indices read as 0, so each char hits exactly one half.
+            uint8x16_t s = vorrq_u8(vqtbl4q_u8(lut0, v.val[k]), vqtbl4q_u8(lut1, vsubq_u8(v.val[k], k64)));
+            err = vorrq_u8(err, vorrq_u8(s, v.val[k]));
+            v.val[k] = s;
+        }
+        if(vmaxvq_u8(err) & 0x80) break;
+        uint8x16x3_t r;
+        r.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+        r.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+        r.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+        vst3q_u8((uint8_t*)out, r);
+    }
+    return i;
+}
+
+#endif // B64_NEON
+
+static size_t b64_encode_none(const unsigned char*, size_t, char*){ return 0; }
+static size_t b64_decode_none(const char*, size_t, char*){ return 0; }
+
+static B64Kernel b64_select_kernel(){
+    B64Kernel k[5];
+    int nk=0;
+    k[nk++] = {"scalar", b64_encode_none, b64_decode_none};
+#ifdef B64_X86
+    unsigned r1[4], r7[4];
+    b64_cpuid(0, 0, r1);
+    unsigned max_leaf = r1[0];
+    b64_cpuid(1, 0, r1);
+    bool osxsave = (r1[2] >> 27) & 1;
+    unsigned long long xcr0 = osxsave ? b64_xgetbv() : 0;
+    bool ymm = (xcr0 & 0x6) == 0x6, zmm = (xcr0 & 0xe6) == 0xe6;
+    if(max_leaf >= 7) b64_cpuid(7, 0, r7); else memset(r7, 0, sizeof(r7));
+    if((r1[2] >> 19) & 1) k[nk++] = {"sse41", b64_encode_sse41, b64_decode_sse41};
+    if(ymm && ((r7[1] >> 5) & 1)) k[nk++] = {"avx2", b64_encode_avx2, b64_decode_avx2};
+    if(zmm && ((r7[1] >> 16) & 1) && ((r7[1] >> 30) & 1) && ((r7[2] >> 1) & 1))
+        k[nk++] = {"avx512vbmi", b64_encode_avx512vbmi, b64_decode_avx512vbmi};
+#endif
+#ifdef B64_NEON
+    k[nk++] = {"neon", b64_encode_neon, b64_decode_neon};
+#endif
+    if(const char* want = getenv("B64_KERNEL"))
+        for(int i=0;i<nk;++i) if(!strcmp(k[i].name, want)) return k[i];
+    return k[nk-1];
+}
+
+static const B64Kernel b64_kernel = b64_select_kernel();
+
+static inline const char* b64_kernel_name(){ return b64_kernel.name; }
+
+// ----- Public API -----
+static inline size_t b64_encoded_len(size_t n){ return ((n+2)/3)*4; }
+static inline size_t b64_decoded_max(size_t n){ return (n/4)*3; }
+
+// Encodes `in` into out[0..cap); returns b64_encoded_len(in.size()), or -1
+// if cap is smaller than that.
+static inline long b64_encode_into(std::string_view in, char* out, size_t cap){
+    const unsigned char* d=(const unsigned char*)in.data();
+    size_t n=in.size(), len=b64_encoded_len(n);
+    if(cap<len) return -1;
+    size_t done=b64_kernel.encode(d, n, out);
+    b64_encode_scalar(d+done, n-done, out + done/3*4);
+    return (long)len;
+}
+
+// Decodes `in` into out[0..cap); cap must be at least b64_decoded_max(in.size()).
+// Returns the decoded length, or -1 if `in` is not Base64 or cap is too small.
+static inline long b64_decode_into(std::string_view in, char* out, size_t cap){
+    if(in.size()%4 || cap<b64_decoded_max(in.size())) return -1;
+    size_t done=b64_kernel.decode(in.data(), in.size(), out);
+    long tail=b64_decode_scalar(in.data()+done, in.size()-done, out + done/4*3);
+    return tail<0 ? -1 : (long)(done/4*3) + tail;
+}
+
+static inline std::string b64_encode(const std::string& in){
+    std::string out(b64_encoded_len(in.size()), '\0');
+    b64_encode_into(in, &out[0], out.size());
+    return out;
+}
+
+static inline bool b64_decode(const std::string& in, std::string& out){
+    out.resize(b64_decoded_max(in.size()));
+    long n=b64_decode_into(in, &out[0], out.size());
+    if(n<0) return false;
+    out.resize((size_t)n);
+    return true;
+}
@@ -1,151 +1,684 @@
 // client.cpp — Hybrid TCP/UDP Pub/Sub Client (Base64), multi-topic subscribe
 // Build: g++ -std=c++17 -O2 -pthread client.cpp -o client
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <chrono>
 
+#include "base64.h"
+#include "latency_histogram.h"
+#include "output_sink.h"
+#include "payload_codec.h"
+#include "protocol.h"
+
 using namespace std;
 
-// ----- Protocol -----
-const int SUBSCRIBE = 1;
-const int PUBLISH   = 2;
-const int MSG       = 3;
-const int ACK       = 4;
-const int TERM      = 5;
+// ----- I/O helpers (TCP) -----
 
-struct Header { int type, topic_len, payload_len; };
+// Held for a whole send so a heartbeat PING from its own thread never lands inside another frame
+static mutex send_mtx;
 
-// ----- I/O helpers (TCP) -----
-static bool send_all(int fd, const void* buf, size_t len){
-    const char* p=(const char*)buf;
-    while(len){
-        ssize_t n=send(fd,p,len,0);
-        if(n<0){ if(errno==EINTR) continue; return false; }
-        p+=n; len-= (size_t)n;
+// sendmsg until every iovec is written; MSG_NOSIGNAL turns a dead peer into an error
+static bool send_iov_all(int fd, iovec* iov, int n){
+    lock_guard<mutex> lock(send_mtx);
+    while(n){
+        msghdr m{}; m.msg_iov=iov; m.msg_iovlen=(size_t)n;
+        ssize_t w=sendmsg(fd, &m, MSG_NOSIGNAL);
+        if(w<0){ if(errno==EINTR) continue; return false; }
+        while(n && (size_t)w>=iov->iov_len){ w-=(ssize_t)iov->iov_len; ++iov; --n; }
+        if(n){ iov->iov_base=(char*)iov->iov_base+w; iov->iov_len-=(size_t)w; }
     }
     return true;
 }
-static bool recv_all(int fd, void* buf, size_t len){
-    char* p=(char*)buf;
-    while(len){
-        ssize_t n=recv(fd,p,len,0);
-        if(n==0) return false; // closed
-        if(n<0){ if(errno==EINTR) continue; return false; }
-        p+=n; len-= (size_t)n;
+
+// Header (on the stack), topic and payload as one iovec each: nothing is copied
+static int frame_iov(iovec* iov, char* head, int type, string_view topic, string_view payload, uint64_t seq=0){
+    size_t hn=(size_t)(write_head(head, type, topic.size(), payload.size(), seq)-head);
+    iov[0].iov_base=head;                 iov[0].iov_len=hn;
+    iov[1].iov_base=(void*)topic.data();   iov[1].iov_len=topic.size();
+    iov[2].iov_base=(void*)payload.data(); iov[2].iov_len=payload.size();
+    return 3;
+}
+
+// TCP packet send
+static bool send_packet_tcp(int fd, int type, string_view topic, string_view payload, uint64_t seq=0){
+    char head[sizeof(Header)+8]; iovec iov[3];
+    return send_iov_all(fd, iov, frame_iov(iov, head, type, topic, payload, seq));
+}
+// Read-ahead receive: one recv takes whatever the socket holds and frames are
+// parsed where they landed. A returned FrameView points into the buffer and
+// stays valid until the next call.
+#define RECV_BUF (128*1024)   // initial size; grows to the largest frame seen
+struct TcpReader {
+    vector<char> buf=vector<char>(RECV_BUF); size_t off=0, end=0;
+    bool closed=false;   // set on close, error or a malformed frame; not on an SO_RCVTIMEO timeout
+    // false when no frame was read
+    bool next(int fd, FrameView& f){
+        while(true){
+            long used=parse_frame(buf.data()+off, end-off, f);
+            if(used>0){ off+=(size_t)used; return true; }
+            if(used<0){ closed=true; return false; }
+            if(off){ memmove(buf.data(), buf.data()+off, end-off); end-=off; off=0; }
+            size_t need=peek_frame_size(buf.data(), end);
+            if(need>buf.size()) buf.resize(need);
+            ssize_t n=recv(fd, buf.data()+end, buf.size()-end, 0);
+            if(n==0){ closed=true; return false; }
+            if(n<0){ if(errno==EINTR) continue; if(errno!=EAGAIN && errno!=EWOULDBLOCK) closed=true; return false; }
+            end+=(size_t)n;
+        }
     }
-    return true;
+};
+
+// ----- I/O helpers (UDP) -----
+// One datagram = Header || topic || payload, gathered by the kernel
+static bool send_packet_udp(int ufd, const sockaddr_in& to, int type, string_view topic, string_view payload, uint64_t seq=0){
+    char head[sizeof(Header)+8]; iovec iov[3];
+    msghdr m{}; m.msg_name=(void*)&to; m.msg_namelen=sizeof(to);
+    m.msg_iov=iov; m.msg_iovlen=(size_t)frame_iov(iov, head, type, topic, payload, seq);
+    ssize_t n = sendmsg(ufd, &m, 0);
+    return n==(ssize_t)frame_size(topic.size(), payload.size(), type);
+}
+static bool fits_udp(string_view topic, string_view payload, int type){ return frame_size(topic.size(), payload.size(), type)<=UDP_MAX_FRAME; }
+
+// Receives up to UDP_RX_BATCH datagrams per recvmmsg into its own buffers, so
+// every receiving thread owns one and nothing is shared. A returned FrameView
+// points into the datagram and stays valid until the next call.
+#define UDP_RX_BATCH 16
+#define UDP_RX_SLOT  65536   // the largest UDP payload fits
+struct UdpReader {
+    vector<char> buf=vector<char>((size_t)UDP_RX_BATCH*UDP_RX_SLOT);
+    mmsghdr hdr[UDP_RX_BATCH]; iovec iov[UDP_RX_BATCH]; sockaddr_in from[UDP_RX_BATCH];
+    int got=0, at=0;   // datagrams in the batch; next one to hand out
+    // Next well-formed datagram; false on timeout (SO_RCVTIMEO) or error, or
+    // at once when nothing is queued with wait=MSG_DONTWAIT.
+    // Truncated and malformed datagrams are skipped.
+    bool next(int ufd, FrameView& f, sockaddr_in* from_opt=nullptr, int wait=MSG_WAITFORONE){
+        while(true){
+            while(at<got){
+                int i=at++;
+                long used=parse_frame(slot(i), hdr[i].msg_len, f);
+                if((hdr[i].msg_hdr.msg_flags & MSG_TRUNC) || used<=0 || used!=(long)hdr[i].msg_len) continue;
+                if(from_opt) *from_opt=from[i];
+                return true;
+            }
+            memset(hdr, 0, sizeof(hdr));
+            for(int i=0;i<UDP_RX_BATCH;++i){
+                iov[i].iov_base=slot(i); iov[i].iov_len=UDP_RX_SLOT;
+                hdr[i].msg_hdr.msg_iov=&iov[i]; hdr[i].msg_hdr.msg_iovlen=1;
+                hdr[i].msg_hdr.msg_name=&from[i]; hdr[i].msg_hdr.msg_namelen=sizeof(from[i]);
+            }
+            // Blocks for the first datagram only, then takes what is already queued.
+            int n=recvmmsg(ufd, hdr, UDP_RX_BATCH, wait, nullptr);
+            got=n>0 ? n : 0; at=0;
+            if(n<=0) return false;
+        }
+    }
+    char* slot(int i){ return buf.data()+(size_t)i*UDP_RX_SLOT; }
+};
+
+// ----- Base64 framing -----
+// Header || topic || base64(raw), with the payload encoded straight into the
+// reused frame buffer.
+static void build_frame_b64(vector<char>& frame, int type, const string& topic, string_view raw, uint64_t seq=0){
+    size_t elen=b64_encoded_len(raw.size());
+    frame.resize(frame_size(topic.size(), elen, type));
+    char* p=write_head(frame.data(), type, topic.size(), elen, seq);
+    if(!topic.empty()) memcpy(p, topic.data(), topic.size());
+    b64_encode_into(raw, p+topic.size(), elen);
 }
 
-// TCP packet send/recv
-static bool send_packet_tcp(int fd, int type, const string& topic, const string& payload){
-    Header h; h.type=htonl(type); h.topic_len=htonl((int)topic.size()); h.payload_len=htonl((int)payload.size());
-    if(!send_all(fd,&h,sizeof(h))) return false;
-    if(!topic.empty()   && !send_all(fd, topic.data(),   topic.size()))   return false;
-    if(!payload.empty() && !send_all(fd, payload.data(), payload.size())) return false;
+// ----- Subscriber output -----
+// Receive loops format records and hand them to an OutputSink, whose writer
+// thread does the actual console or file writes in large blocks.
+enum OutFmt { OUT_TEXT, OUT_RAW, OUT_DECODED, OUT_NDJSON, OUT_BINARY, OUT_COUNT };
+
+static bool parse_out_fmt(const string& s, OutFmt& f){
+    if(s=="text") f=OUT_TEXT; else if(s=="raw") f=OUT_RAW; else if(s=="decoded") f=OUT_DECODED;
+    else if(s=="ndjson") f=OUT_NDJSON; else if(s=="binary") f=OUT_BINARY; else if(s=="count") f=OUT_COUNT;
+    else return false;
     return true;
 }
-static bool recv_packet_tcp(int fd, int& type, string& topic, string& payload){
-    Header h{}; if(!recv_all(fd,&h,sizeof(h))) return false;
-    type=ntohl(h.type);
-    int tlen=ntohl(h.topic_len), plen=ntohl(h.payload_len);
-    topic.assign(tlen,'\0'); payload.assign(plen,'\0');
-    if(tlen && !recv_all(fd, topic.data(), (size_t)tlen)) return false;
-    if(plen && !recv_all(fd, payload.data(), (size_t)plen)) return false;
+
+// Appends the message bytes: Base64-decoded unless FLAG_RAW. false if `pl` is not Base64.
+static bool append_payload(string& out, string_view pl, int flags){
+    if(flags & FLAG_RAW){ out.append(pl); return true; }
+    size_t at=out.size(); out.resize(at+b64_decoded_max(pl.size()));
+    long n=b64_decode_into(pl, &out[at], out.size()-at);
+    out.resize(n<0 ? at : at+(size_t)n);
+    return n>=0;
+}
+
+static void append_json_string(string& out, string_view s){
+    static const char hex[]="0123456789abcdef";
+    out.push_back('"');
+    for(char c: s){
+        unsigned char u=(unsigned char)c;
+        if(c=='"' || c=='\\'){ out.push_back('\\'); out.push_back(c); }
+        else if(u<0x20){ out.append("\\u00"); out.push_back(hex[u>>4]); out.push_back(hex[u&15]); }
+        else out.push_back(c);
+    }
+    out.push_back('"');
+}
+
+// Formats one MSG into `rec`, replacing its contents; an empty `rec` means
+// nothing to write. FLAG_RAW payloads are used as they are.
+//   text     [RECEIVED] Topic='t' [seq=N] base64=... | text=...
+//   raw      the payload as it came off the wire, one per line
+//   decoded  the message bytes only, one per line
+//   ndjson   {"topic":"t","text":"..."}, or "base64" and "error" if it does not decode;
+//            MSGs carrying their topic seq (--seq, --replay) add "seq":N
+//   binary   u32 topic length, u32 message length (network order), topic, message;
+//            messages that do not decode are skipped
+static void format_msg(string& rec, OutFmt fmt, const FrameView& f){
+    string_view tp=f.topic, pl=f.payload; int flags=f.flags;
+    rec.clear();
+    switch(fmt){
+    case OUT_TEXT:
+        rec.append("[RECEIVED] Topic='").append(tp).push_back('\'');
+        if(flags & FLAG_SEQ) rec.append(" seq=").append(to_string(f.seq));
+        if(flags & FLAG_RAW) rec.append(" raw=").append(to_string(pl.size())).append(" bytes | text=");
+        else rec.append(" base64=").append(pl).append(" | text=");
+        if(!append_payload(rec, pl, flags)) rec.append("<b64-decode-error>");
+        rec.push_back('\n');
+        break;
+    case OUT_RAW:
+        rec.append(pl).push_back('\n');
+        break;
+    case OUT_DECODED:
+        if(!append_payload(rec, pl, flags)) rec.append("<b64-decode-error>");
+        rec.push_back('\n');
+        break;
+    case OUT_NDJSON: {
+        rec.append("{\"topic\":"); append_json_string(rec, tp);
+        if(flags & FLAG_SEQ) rec.append(",\"seq\":").append(to_string(f.seq));
+        string body;
+        if(append_payload(body, pl, flags)){ rec.append(",\"text\":"); append_json_string(rec, body); }
+        else{ rec.append(",\"base64\":"); append_json_string(rec, pl); rec.append(",\"error\":\"b64-decode\""); }
+        rec.append("}\n");
+        break;
+    }
+    case OUT_BINARY: {
+        rec.resize(8); rec.append(tp);
+        if(!append_payload(rec, pl, flags)){ rec.clear(); break; }
+        put_u32(&rec[0], (uint32_t)tp.size()); put_u32(&rec[4], (uint32_t)(rec.size()-8-tp.size()));
+        break;
+    }
+    case OUT_COUNT:
+        break;
+    }
+}
+
+// ----- Compressed MSGs (--compress) -----
+// The zstd dictionaries the server sent (TYPE_DICT), by id. Kept for good:
+// other receive threads may be using them.
+struct DictStore {
+    mutex mtx; unordered_map<uint32_t, unique_ptr<ZstdDictionary>> by_id;
+    void add(string_view bytes){
+        unique_ptr<ZstdDictionary> d(new ZstdDictionary(string(bytes), ZstdDictionary::Decompress));
+        if(!d->id()) return;
+        lock_guard<mutex> lock(mtx); by_id.emplace(d->id(), move(d));
+    }
+    const ZstdDictionary* find(uint32_t id){
+        lock_guard<mutex> lock(mtx); auto it=by_id.find(id);
+        return it==by_id.end() ? nullptr : it->second.get();
+    }
+};
+static DictStore dicts;
+
+// Decompresses a FLAG_LZ4/FLAG_ZSTD MSG into `plain`; `f` then is the raw MSG it was.
+static bool inflate_msg(FrameView& f, string& plain){
+    int codec=f.flags & CODEC_MASK; const ZstdDictionary* d=nullptr;
+    if(codec==FLAG_ZSTD){ uint32_t id=payload_dict_id(f.payload); if(id && !(d=dicts.find(id))) return false; }
+    if(!decompress_payload(codec, d, f.payload, plain)) return false;
+    f.payload=plain; f.flags&=~CODEC_MASK;
     return true;
 }
 
-// ----- I/O helpers (UDP) -----
-// Build datagram = Header || topic || payload
-static bool send_packet_udp(int ufd, const sockaddr_in& to, int type, const string& topic, const string& payload){
-    Header h; h.type=htonl(type); h.topic_len=htonl((int)topic.size()); h.payload_len=htonl((int)payload.size());
-    vector<char> buf; buf.reserve(sizeof(h)+topic.size()+payload.size());
-    buf.insert(buf.end(), (char*)&h, (char*)&h + sizeof(h));
-    buf.insert(buf.end(), topic.begin(), topic.end());
-    buf.insert(buf.end(), payload.begin(), payload.end());
-    ssize_t n = sendto(ufd, buf.data(), buf.size(), 0, (const sockaddr*)&to, sizeof(to));
-    return n==(ssize_t)buf.size();
+// One per receiving thread: its sink producer plus reused record and
+// decompression buffers. Status lines share the sink when it writes
+// human-readable text to stdout, which keeps them in order with the
+// messages; otherwise they go to `status`.
+struct MsgOut {
+    OutputSink::Producer* sink=nullptr; OutFmt fmt=OUT_TEXT; ostream* status=nullptr; string rec, plain;
+    void msg(const FrameView& f){
+        sink->count_one();
+        if(fmt==OUT_COUNT) return;
+        FrameView m=f;
+        if((m.flags & CODEC_MASK) && !inflate_msg(m, plain)){ note("[WARN] cannot decompress a MSG on '"+string(f.topic)+"'\n"); return; }
+        format_msg(rec, fmt, m);
+        if(!rec.empty()) sink->push(rec);
+    }
+    void note(const string& line){ if(status) *status<<line<<flush; else sink->push(line); }
+};
+
+// ----- Reliable UDP (--reliable) -----
+// MSGs carry their topic seq and each topic is delivered strictly in seq
+// order. A gap holds the later MSGs back and NACKs the missing range, again
+// every UDP_NACK_RETRY_MS; the server resends it from its window (--udp-window)
+// or NACKs back what it no longer has, and the topic skips ahead past that.
+// Topics are independent: a gap on one never holds back another.
+#define UDP_NACK_RETRY_MS 50
+#define UDP_NACK_TRIES    20     // then the gap is given up as lost
+#define UDP_PROBE_MS      1000   // a quiet topic asks for anything after its last seq
+#define UDP_HOLD_MAX      4096   // MSGs held per topic; one more gives the gap up
+#define UDP_TICK_MS       10     // how often the topics are checked for due NACKs
+struct ReliableRx {
+    typedef chrono::steady_clock Clock;
+    struct Topic {
+        uint64_t next=0;                    // next seq to deliver; 0 until the first MSG or ACK
+        map<uint64_t, vector<char>> held;   // whole frames past the gap
+        Clock::time_point nack_at, heard;
+        int tries=0;
+    };
+    int fd; sockaddr_in srv; MsgOut* out;
+    unordered_map<string, Topic> topics;
+    uint64_t lost=0;
+    Clock::time_point next_tick;
+    ReliableRx(int fd, const sockaddr_in& srv, MsgOut* out): fd(fd), srv(srv), out(out){}
+
+    // SUBSCRIBE ACK with the topic's newest seq: deliver from the one after it.
+    void anchor(string_view topic, uint64_t last){ Topic& t=topics[string(topic)]; if(!t.next) t.next=last+1; }
+
+    void on_msg(const FrameView& f, Clock::time_point now){
+        if(!(f.flags & FLAG_SEQ)){ out->msg(f); return; }   // the server does not number MSGs
+        auto it=topics.try_emplace(string(f.topic)).first; Topic& t=it->second;
+        t.heard=now;
+        if(!t.next) t.next=f.seq;
+        if(f.seq<t.next) return;   // duplicate, or part of a gap given up
+        if(f.seq==t.next){ out->msg(f); ++t.next; release(t); return; }
+        if(t.held.size()>=UDP_HOLD_MAX) skip(it->first, t, t.held.begin()->first);
+        vector<char> frame; encode_frame(frame, TYPE_MSG | f.flags, f.topic, f.payload, f.seq);
+        bool fresh=t.held.empty();
+        t.held.emplace(f.seq, move(frame));
+        if(fresh){ t.tries=0; nack(it->first, t, t.held.begin()->first-t.next, now); }
+    }
+
+    // The server's NACK: [seq, seq+count) is gone.
+    void on_nack(const FrameView& f){
+        if(!(f.flags & FLAG_SEQ) || f.payload.size()!=8) return;
+        auto it=topics.find(string(f.topic));
+        uint64_t end=f.seq+get_u64(f.payload.data());
+        if(it!=topics.end() && f.seq<=it->second.next) skip(it->first, it->second, end);
+    }
+
+    // Retries the NACKs that went unanswered, and probes quiet topics for
+    // lost tail messages, which no later MSG would reveal.
+    void tick(Clock::time_point now){
+        if(now<next_tick) return;
+        next_tick=now+chrono::milliseconds(UDP_TICK_MS);
+        for(auto& kv: topics){
+            Topic& t=kv.second;
+            if(!t.next || now<t.nack_at) continue;
+            if(!t.held.empty()){
+                if(++t.tries>UDP_NACK_TRIES) skip(kv.first, t, t.held.begin()->first);
+                else nack(kv.first, t, t.held.begin()->first-t.next, now);
+            }else if(now-t.heard>=chrono::milliseconds(UDP_PROBE_MS)){
+                nack(kv.first, t, 0, now);
+                t.nack_at=now+chrono::milliseconds(UDP_PROBE_MS);
+            }
+        }
+    }
+
+private:
+    void nack(const string& name, Topic& t, uint64_t count, Clock::time_point now){
+        char n[8]; put_u64(n, count);
+        (void)send_packet_udp(fd, srv, TYPE_NACK | FLAG_SEQ, name, string_view(n, 8), t.next);
+        t.nack_at=now+chrono::milliseconds(UDP_NACK_RETRY_MS);
+    }
+    // Gives up on everything before `to`.
+    void skip(const string& name, Topic& t, uint64_t to){
+        if(to>t.next){
+            lost+=to-t.next;
+            out->note("[WARN] lost seq "+to_string(t.next)+".."+to_string(to-1)+" on '"+name+"'\n");
+            t.next=to;
+        }
+        t.tries=0;
+        release(t);
+    }
+    // Delivers the held MSGs that are now in order.
+    void release(Topic& t){
+        while(!t.held.empty() && t.held.begin()->first<=t.next){
+            auto h=t.held.begin();
+            if(h->first==t.next){ FrameView m; parse_frame(h->second.data(), h->second.size(), m); out->msg(m); ++t.next; }
+            t.held.erase(h);
+        }
+        if(!t.held.empty()){ t.tries=0; t.nack_at=Clock::time_point(); }   // the next gap, NACKed on the next tick
+    }
+};
+
+// ----- Multicast (--multicast) -----
+// Topics the server maps to a group arrive on a socket of that group's (one
+// per group), bound to the group address as well as its port: the kernel then
+// hands it only that group's datagrams, not other groups' or unicast traffic
+// to the same port.
+struct McastRx {
+    vector<int> fds; vector<string> groups;   // groups as FLAG_MCAST ACK payloads
+    vector<unique_ptr<UdpReader>> readers;
+    // `where` is a FLAG_MCAST ACK's payload; false, with errno set, if the group cannot be joined
+    bool join(string_view where){
+        if(where.size()!=6){ errno=EINVAL; return false; }
+        if(find(groups.begin(), groups.end(), where)!=groups.end()) return true;   // joined for another topic
+        ip_mreq mr{}; uint16_t port;
+        memcpy(&mr.imr_multiaddr.s_addr, where.data(), 4); memcpy(&port, where.data()+4, 2);
+        mr.imr_interface.s_addr=htonl(INADDR_ANY);
+        int m=socket(AF_INET, SOCK_DGRAM, 0);
+        if(m<0) return false;
+        int on=1; setsockopt(m, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));   // other subscribers on this host
+        sockaddr_in a{}; a.sin_family=AF_INET; a.sin_port=port; a.sin_addr=mr.imr_multiaddr;
+        if(bind(m, (sockaddr*)&a, sizeof(a))<0 || setsockopt(m, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mr, sizeof(mr))<0){
+            int e=errno; ::close(m); errno=e; return false;
+        }
+        fds.push_back(m); groups.emplace_back(where); readers.emplace_back(new UdpReader);
+        return true;
+    }
+    static string name(string_view where){
+        char ip[INET_ADDRSTRLEN]; uint16_t port; memcpy(&port, where.data()+4, 2);
+        inet_ntop(AF_INET, where.data(), ip, sizeof(ip));
+        return string(ip)+":"+to_string(ntohs(port));
+    }
+};
+
+// One UDP receive worker: formats MSGs until the process ends. The main
+// worker also serves the multicast sockets, if any, by polling all of them.
+static void udp_receive_loop(int fd, UdpReader& ur, MsgOut& out, ReliableRx* rel=nullptr, McastRx* mc=nullptr){
+    FrameView f;
+    auto handle=[&](ReliableRx::Clock::time_point now){
+        if(f.type==TYPE_MSG){ if(rel) rel->on_msg(f, now); else out.msg(f); }
+        else if(f.type==TYPE_NACK){ if(rel) rel->on_nack(f); }
+        else if(f.type==TYPE_ACK) out.note("[ACK] (unsolicited UDP)\n");   // e.g., from server after a prior action
+    };
+    if(!mc || mc->fds.empty()){
+        while(true){
+            bool got=ur.next(fd, f);   // timeout just means no packets recently; continue listening
+            auto now=rel ? ReliableRx::Clock::now() : ReliableRx::Clock::time_point();
+            if(rel) rel->tick(now);
+            if(got) handle(now);
+        }
+    }
+    vector<pollfd> pf{{fd, POLLIN, 0}};
+    for(int m: mc->fds) pf.push_back({m, POLLIN, 0});
+    while(true){
+        if(poll(pf.data(), pf.size(), UDP_NACK_RETRY_MS)<0 && errno!=EINTR){ perror("poll"); return; }
+        auto now=rel ? ReliableRx::Clock::now() : ReliableRx::Clock::time_point();
+        for(size_t i=0;i<pf.size();++i){
+            if(!(pf[i].revents & POLLIN)) continue;
+            UdpReader& r=i ? *mc->readers[i-1] : ur;
+            while(r.next(pf[i].fd, f, nullptr, MSG_DONTWAIT)) handle(now);
+        }
+        if(rel) rel->tick(now);
+    }
 }
 
-// Parse one datagram into (type, topic, payload); returns false if malformed
-static bool parse_datagram(const char* data, size_t n, int& type, string& topic, string& payload){
-    if(n < sizeof(Header)) return false;
-    Header h{};
-    memcpy(&h, data, sizeof(h));
-    type = ntohl(h.type);
-    int tlen = ntohl(h.topic_len);
-    int plen = ntohl(h.payload_len);
-    size_t need = sizeof(h) + (size_t)tlen + (size_t)plen;
-    if(n < need) return false;
-    topic.assign(data + sizeof(h), (size_t)tlen);
-    payload.assign(data + sizeof(h) + tlen, (size_t)plen);
+// TCP subscriber receive loop; returns when the server closes the connection
+static void tcp_receive_loop(int fd, TcpReader& rd, MsgOut& out){
+    FrameView f;
+    while(true){
+        if(!rd.next(fd, f)){ cerr<<"[INFO] Server closed connection.\n"; return; }
+        if(f.type==TYPE_MSG) out.msg(f);
+        else if(f.type==TYPE_DICT) dicts.add(f.payload);
+        else if(f.type==TYPE_ACK) out.note("[ACK] (unsolicited TCP)\n");
+    }
+}
+
+// ----- Pipelined publisher (TCP) -----
+#define PUB_BATCH 64   // frames per gather-send
+#define ECHO_MAX 256   // longest Base64 payload an ACK line repeats
+
+static bool readable_now(int fd){ pollfd p{fd, POLLIN, 0}; return poll(&p, 1, 0)>0; }
+
+// Whole file into `out` (a snapshot, an image) for pub --file
+static bool read_file(const string& path, string& out){
+    int f=open(path.c_str(), O_RDONLY); if(f<0) return false;
+    out.clear(); char buf[65536]; ssize_t n;
+    while((n=read(f, buf, sizeof(buf)))>0) out.append(buf, (size_t)n);
+    ::close(f); return n==0;
+}
+
+// Lines from fd 0, read in large chunks so that whatever is already there
+// can be taken without blocking (cin cannot tell that while synced with stdio).
+// A returned line stays valid until the next call.
+struct StdinLines {
+    vector<char> buf=vector<char>(64*1024); size_t off=0, end=0; bool eof=false;
+    bool done() const { return eof && off==end; }
+    bool next(string_view& line, bool wait){
+        while(true){
+            char* b=buf.data()+off; char* nl=(char*)memchr(b, '\n', end-off);
+            if(nl){ line=string_view(b, (size_t)(nl-b)); off+=(size_t)(nl-b)+1; return true; }
+            if(eof && off<end){ line=string_view(b, end-off); off=end; return true; }
+            if(eof || !wait) return false;
+            if(off){ memmove(buf.data(), b, end-off); end-=off; off=0; }
+            if(buf.size()-end < 4096) buf.resize(max<size_t>(buf.size()*2, 64*1024));
+            ssize_t r=read(0, buf.data()+end, buf.size()-end);
+            if(r<0 && errno==EINTR) continue;
+            if(r<=0) eof=true; else end+=(size_t)r;
+        }
+    }
+};
+
+// Keeps up to `window` PUBLISHes in flight. Each carries FLAG_SEQ and the
+// server's ACK repeats it; TCP keeps them in order, so an ACK for seq s
+// confirms everything up to s. Lines already read from stdin go out
+// together, up to PUB_BATCH frames per sendmsg. `ack_flags` is 0 (one ACK
+// per publish), FLAG_CUMACK (the server batches them) or FLAG_NOACK (none
+// are sent; the window never fills). Returns false if the connection fails.
+static bool publish_pipelined(int fd, TcpReader& rd, const string& topic, bool raw, uint64_t window, int ack_flags){
+    vector<vector<char>> frames(PUB_BATCH); iovec iov[PUB_BATCH];
+    uint64_t next=1, acked=0;   // next seq to send; highest seq confirmed
+    StdinLines in; bool eof=false;
+    bool noack=ack_flags & FLAG_NOACK;
+    int pub_type=TYPE_PUBLISH | (raw ? FLAG_RAW : 0) | (noack ? FLAG_NOACK : FLAG_SEQ | ack_flags);
+    FrameView a;
+    auto t0=chrono::steady_clock::now();
+    auto read_ack=[&]{
+        if(!rd.next(fd, a)) return false;
+        if(a.type!=TYPE_ACK || !(a.flags & FLAG_SEQ)) return true;
+        if(a.seq<=acked || a.seq>=next) cerr<<"[WARN] ACK for unexpected seq "<<a.seq<<"\n";
+        else acked=a.seq;
+        return true;
+    };
+    while(!eof || acked+1<next){
+        int n=0;
+        while(!eof && n<PUB_BATCH && next-1-acked<window){
+            string_view line;
+            if(!in.next(line, n==0)){ eof=in.done(); break; }
+            vector<char>& f=frames[n];
+            if(raw){ f.clear(); encode_frame(f, pub_type, topic, line, next); }
+            else build_frame_b64(f, pub_type, topic, line, next);
+            iov[n].iov_base=f.data(); iov[n].iov_len=f.size();
+            ++n; ++next;
+        }
+        if(n && !send_iov_all(fd, iov, n)){ cerr<<"[ERROR] TCP send PUBLISH failed\n"; return false; }
+        if(noack){ acked=next-1; continue; }
+        // Block on ACKs only with a full window or no more input; otherwise take what has arrived.
+        bool must = next-1-acked>=window || (eof && acked+1<next);
+        while(acked+1<next && (must || rd.off<rd.end || readable_now(fd))){
+            if(!read_ack()){ cerr<<"[ERROR] Connection lost with "<<next-1-acked<<" publish(es) unconfirmed\n"; return false; }
+            must=false;
+        }
+    }
+    double secs=chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    cout<<"[DONE] "<<acked<<" PUBLISH(es) "<<(noack ? "sent" : "confirmed")<<" in "<<secs<<" s ("
+        <<(secs>0 ? (uint64_t)(acked/secs) : acked)<<" msgs/s, ";
+    if(noack) cout<<"no ACKs)\n"; else cout<<(ack_flags & FLAG_CUMACK ? "cumulative ACKs, " : "")<<"window "<<window<<")\n";
     return true;
 }
 
-// With timeout; fills from address if needed
-static bool recv_packet_udp(int ufd, int& type, string& topic, string& payload, sockaddr_in* from_opt=nullptr){
-    static vector<char> buf(64*1024);
-    sockaddr_in from{}; socklen_t flen=sizeof(from);
-    ssize_t n = recvfrom(ufd, buf.data(), buf.size(), 0, (sockaddr*)&from, &flen);
-    if(n < 0){
-        if(errno==EINTR) return false;
-        return false;
-    }
-    if(from_opt) *from_opt = from;
-    return parse_datagram(buf.data(), (size_t)n, type, topic, payload);
+// ----- Benchmark roles -----
+// bench-pub stamps every payload with its send time and a per-topic sequence
+// number and publishes fire-and-forget (FLAG_NOACK) at a target rate.
+// bench-sub turns those stamps into latency percentiles, throughput and loss.
+// Both read steady_clock, so latency is only meaningful on one host.
+#define BENCH_STAMP 16           // u64 send time (ns), u64 per-topic seq
+#define BENCH_REPORT_MS 1000
+#define BENCH_IDLE_MS 2000       // bench-sub stops after this long without messages
+
+struct BenchOpts {
+    uint64_t rate=0;       // --rate N msgs/s; 0 = as fast as possible
+    size_t size=64;        // --size B payload bytes (at least BENCH_STAMP)
+    int topics=1;          // --topics K: <prefix>.0 .. <prefix>.K-1 round-robin; K=1 uses <prefix>
+    uint64_t count=100000; // --count N messages to send / expect
+    double seconds=0;      // --seconds S: run for S seconds instead of --count
+};
+
+static uint64_t now_ns(){
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static vector<string> bench_topics(const string& prefix, int k){
+    vector<string> t;
+    for(int i=0;i<k;++i) t.push_back(k==1 ? prefix : prefix+"."+to_string(i));
+    return t;
 }
 
-// ----- Base64 -----
-static const char* B64="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static unsigned char REV[256];
-static void init_rev(){
-    for(int i=0;i<256;++i) REV[i]=255;
-    for(int i=0;i<64;++i) REV[(unsigned char)B64[i]]=(unsigned char)i;
-    REV[(unsigned char)'=']=254;
+// ----- Heartbeat -----
+// A server started with --idle-timeout drops clients it has not heard from;
+// a quiet subscriber or an idle interactive publisher PINGs every `every_s`.
+#define DEFAULT_HEARTBEAT_S 10   // well inside any sensible --idle-timeout
+
+static void start_heartbeat(int fd, bool udp, const sockaddr_in& srv, double every_s){
+    if(every_s<=0) return;
+    thread([fd, udp, srv, every_s]{
+        while(true){
+            this_thread::sleep_for(chrono::duration<double>(every_s));
+            bool ok=udp ? send_packet_udp(fd, srv, TYPE_PING, "", "") : send_packet_tcp(fd, TYPE_PING, "", "");
+            if(!ok && !udp) return;   // connection gone; the main thread finds out on its own
+        }
+    }).detach();
+}
+
+static bool bench_publish(int fd, bool udp, const sockaddr_in& srv, const string& prefix, bool raw, const BenchOpts& o){
+    vector<string> names=bench_topics(prefix, o.topics);
+    vector<uint64_t> seq(names.size(), 0);
+    string body(max(o.size, (size_t)BENCH_STAMP), 'x');
+    vector<vector<char>> frames(PUB_BATCH); iovec iov[PUB_BATCH];
+    int type=TYPE_PUBLISH | FLAG_NOACK | (raw ? FLAG_RAW : 0);
+    uint64_t sent=0, dropped=0, bytes=0;
+    auto t0=chrono::steady_clock::now();
+    while(true){
+        double el=chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+        if(o.seconds>0 ? el>=o.seconds : sent>=o.count) break;
+        uint64_t room=o.seconds>0 ? UINT64_MAX : o.count-sent;
+        if(o.rate){
+            // Paced on the schedule since t0, so a late batch is made up rather than lost.
+            uint64_t due=(uint64_t)(el*(double)o.rate)+1;
+            if(due<=sent){
+                double wait=(double)(sent+1)/(double)o.rate-el;
+                if(wait>100e-6) this_thread::sleep_for(chrono::duration<double>(wait-50e-6));
+                continue;
+            }
+            room=min(room, due-sent);
+        }
+        int n=(int)min<uint64_t>(room, PUB_BATCH);
+        for(int k=0;k<n;++k){
+            size_t t=(size_t)((sent+(uint64_t)k)%names.size());
+            put_u64(&body[0], now_ns()); put_u64(&body[8], ++seq[t]);
+            vector<char>& f=frames[k];
+            if(raw){ f.clear(); encode_frame(f, type, names[t], body); }
+            else build_frame_b64(f, type, names[t], body);
+            iov[k].iov_base=f.data(); iov[k].iov_len=f.size(); bytes+=f.size();
+        }
+        if(udp){
+            // Loss-tolerant like the rest of UDP: a datagram the socket refuses is counted, not retried.
+            for(int k=0;k<n;++k)
+                if(sendto(fd, iov[k].iov_base, iov[k].iov_len, 0, (const sockaddr*)&srv, sizeof(srv))<0) ++dropped;
+        }else if(!send_iov_all(fd, iov, n)){ cerr<<"[ERROR] TCP send PUBLISH failed\n"; return false; }
+        sent+=(uint64_t)n;
+    }
+    double secs=chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+    cout<<"[BENCH] sent "<<sent<<" msgs ("<<body.size()<<" B, "<<names.size()<<" topic(s)) in "<<secs<<" s: "
+        <<(uint64_t)(sent/secs)<<" msgs/s, "<<bytes/secs/1e6<<" MB/s on the wire";
+    if(dropped) cout<<", "<<dropped<<" refused by the socket";
+    cout<<"\n";
+    return true;
 }
-static string b64_encode(const string& in){
-    const unsigned char* d=(const unsigned char*)in.data();
-    size_t n=in.size(); string out; out.reserve(((n+2)/3)*4);
-    for(size_t i=0;i<n;i+=3){
-        unsigned int v = d[i]<<16;
-        if(i+1<n) v |= d[i+1]<<8;
-        if(i+2<n) v |= d[i+2];
-        out.push_back(B64[(v>>18)&63]);
-        out.push_back(B64[(v>>12)&63]);
-        out.push_back(i+1<n ? B64[(v>>6)&63] : '=');
-        out.push_back(i+2<n ? B64[v&63]     : '=');
-    }
-    return out;
+
+static void bench_latency(ostream& os, const LatencyHistogram& h){
+    auto us=[](uint64_t ns){ return (double)ns/1000.0; };
+    os<<"p50="<<us(h.percentile(50))<<" p99="<<us(h.percentile(99))<<" p99.9="<<us(h.percentile(99.9))
+      <<" max="<<us(h.max())<<" us";
 }
-static bool b64_decode(const string& in, string& out){
-    static bool inited=false; if(!inited){ init_rev(); inited=true; }
-    if(in.size()%4) return false;
-    out.clear(); out.reserve((in.size()/4)*3);
-    for(size_t i=0;i<in.size(); i+=4){
-        int c0=REV[(unsigned char)in[i]];
-        int c1=REV[(unsigned char)in[i+1]];
-        int c2=REV[(unsigned char)in[i+2]];
-        int c3=REV[(unsigned char)in[i+3]];
-        if(c0==255 || c1==255 || c2==255 || c3==255) return false;
-        unsigned int v = ((unsigned int)c0<<18) | ((unsigned int)c1<<12);
-        out.push_back((char)((v>>16)&0xFF));
-        if(c2!=254){
-            v |= (unsigned int)c2<<6;
-            out.push_back((char)((v>>8)&0xFF));
-            if(c3!=254){
-                v |= (unsigned int)c3;
-                out.push_back((char)(v&0xFF));
+
+static bool bench_subscribe(int fd, bool udp, const sockaddr_in& srv, const string& prefix, bool raw, const BenchOpts& o,
+                            TcpReader& rd, UdpReader& ur){
+    vector<string> names=bench_topics(prefix, o.topics);
+    unordered_map<string_view, size_t> index;
+    for(size_t i=0;i<names.size();++i) index.emplace(names[i], i);
+    vector<uint64_t> last(names.size(), 0);
+    // Wake up regularly so reports and the idle stop happen without traffic.
+    timeval tv{0, 200*1000}; setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int sub_type=TYPE_SUBSCRIBE | (raw ? FLAG_RAW : 0);
+    for(auto& t: names){
+        bool ok=udp ? send_packet_udp(fd, srv, sub_type, t, "") : send_packet_tcp(fd, sub_type, t, "");
+        if(!ok){ cerr<<"[ERROR] send SUBSCRIBE '"<<t<<"' failed\n"; return false; }
+    }
+    cout<<"[BENCH] subscribed to "<<names.size()<<" topic(s) via "<<(udp ? "UDP" : "TCP")<<"; waiting for bench-pub\n";
+
+    LatencyHistogram total, interval;
+    uint64_t got=0, lost=0, late=0, foreign=0, acks=0, iv_got=0;
+    string dec; FrameView f;
+    auto start=chrono::steady_clock::now(), first=start, last_msg=start, last_report=start;
+    while(true){
+        bool have=udp ? ur.next(fd, f) : rd.next(fd, f);
+        auto now=chrono::steady_clock::now();
+        if(have && f.type==TYPE_ACK) ++acks;
+        else if(have && f.type==TYPE_MSG){
+            string_view p=f.payload;
+            if(!(f.flags & FLAG_RAW)){
+                dec.resize(b64_decoded_max(p.size()));
+                long n=b64_decode_into(p, &dec[0], dec.size());
+                p=n<0 ? string_view() : string_view(dec.data(), (size_t)n);
             }
+            auto it=index.find(f.topic);
+            if(p.size()<BENCH_STAMP || it==index.end()){ ++foreign; continue; }
+            uint64_t sent_at=get_u64(p.data()), s=get_u64(p.data()+8), t=now_ns();
+            uint64_t lat=t>sent_at ? t-sent_at : 0;
+            total.record(lat); interval.record(lat);
+            uint64_t& l=last[it->second];
+            if(s>l+1) lost+=s-l-1;
+            if(s<=l) ++late; else l=s;
+            if(!got) first=now;
+            ++got; ++iv_got; last_msg=now;
         }
+        if(!udp && rd.closed){ cerr<<"[INFO] Server closed connection.\n"; break; }
+        if(now-last_report>=chrono::milliseconds(BENCH_REPORT_MS)){
+            double secs=chrono::duration<double>(now-last_report).count();
+            if(iv_got){
+                cout<<"[BENCH] "<<(uint64_t)(iv_got/secs)<<" msgs/s ";
+                bench_latency(cout, interval);
+                cout<<"\n";
+            }
+            interval.reset(); iv_got=0; last_report=now;
+        }
+        if(o.seconds>0 ? got && now-first>=chrono::duration<double>(o.seconds) : got+lost>=o.count) break;
+        if(got && now-last_msg>=chrono::milliseconds(BENCH_IDLE_MS)) break;
     }
+    double secs=chrono::duration<double>(last_msg-first).count();
+    cout<<"[BENCH] received "<<got<<" msgs in "<<secs<<" s ("<<(secs>0 ? (uint64_t)(got/secs) : got)<<" msgs/s)"
+        <<", lost "<<lost<<", out of order "<<late;
+    if(foreign) cout<<", "<<foreign<<" not from bench-pub";
+    if(acks<names.size()) cout<<", "<<names.size()-acks<<" SUBSCRIBE(s) unacknowledged";
+    cout<<"\n[BENCH] latency ";
+    bench_latency(cout, total);
+    cout<<" mean="<<total.mean()/1000.0<<" us\n";
     return true;
 }
 
@@ -156,30 +689,169 @@ static string addr_str(const sockaddr_in& a){
     return string(ip) + ":" + to_string((int)ntohs(a.sin_port));
 }
 
+// ----- Cluster seeds (--seeds) -----
+static bool parse_host_port(const string& s, sockaddr_in& a){
+    size_t colon=s.rfind(':'); if(colon==string::npos) return false;
+    a=sockaddr_in{}; a.sin_family=AF_INET;
+    int port=atoi(s.c_str()+colon+1); if(port<=0 || port>65535) return false;
+    a.sin_port=htons((uint16_t)port);
+    return inet_pton(AF_INET, s.substr(0, colon).c_str(), &a.sin_addr)==1;
+}
+
+static bool same_addr(const sockaddr_in& a, const sockaddr_in& b){ return a.sin_addr.s_addr==b.sin_addr.s_addr && a.sin_port==b.sin_port; }
+
+// Asks the first seed that answers where each topic lives (TYPE_LOCATE).
+// owner[i] is topics[i]'s node, or that seed when any node will do: a
+// pattern, or a server that is not clustered. false if no seed answered.
+static bool locate_topics(const vector<sockaddr_in>& seeds, const vector<string>& topics, vector<sockaddr_in>& owner){
+    for(const auto& s: seeds){
+        int fd=socket(AF_INET, SOCK_STREAM, 0); if(fd<0) return false;
+        timeval tv{2,0}; setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));   // a pre-cluster server never answers
+        if(connect(fd,(const sockaddr*)&s,sizeof(s))<0){ ::close(fd); continue; }
+        TcpReader rd; FrameView f; bool ok=true;
+        owner.assign(topics.size(), s);
+        for(size_t i=0;i<topics.size() && ok;++i){
+            ok=send_packet_tcp(fd, TYPE_LOCATE, topics[i], "") && rd.next(fd, f) && f.type==TYPE_ACK;
+            if(ok && f.payload.size()==6){ memcpy(&owner[i].sin_addr.s_addr, f.payload.data(), 4); memcpy(&owner[i].sin_port, f.payload.data()+4, 2); }
+        }
+        ::close(fd);
+        if(ok) return true;
+    }
+    return false;
+}
+
 // ----- Main -----
 int main(int argc, char** argv){
+    // Options may appear anywhere; whatever is left is positional.
+    bool raw=false;        // --raw: publish raw bytes / ask the server for raw MSGs instead of Base64
+    uint64_t window=1;     // --window N: PUBLISHes in flight (TCP); 1 = wait for each ACK
+    bool nodelay=true;     // --nodelay on|off: TCP_NODELAY
+    string ack="each";     // --ack each|cumulative|none: how the server confirms PUBLISHes
+    int threads=1;         // --threads N: UDP subscriber receive workers
+    OutFmt fmt=OUT_TEXT;   // --format text|raw|decoded|ndjson|binary|count, --quiet = count
+    string out_path;       // --out FILE: subscriber output goes there instead of stdout
+    string pub_file;       // --file PATH: pub sends the file as one message instead of reading lines
+    BenchOpts bench;       // --rate --size --topics --count --seconds: bench-pub/bench-sub
+    double heartbeat=DEFAULT_HEARTBEAT_S;  // --heartbeat S: PING interval for sub/pub; 0 = off
+    int sub_flags=0;       // --seq, --replay last|all|N: SUBSCRIBE options
+    uint64_t replay_from=0;
+    bool reliable=false;   // --reliable: UDP sub delivers each topic in order, NACKing gaps
+    int codecs=0;          // --compress lz4|zstd|any: codecs the sub accepts
+    vector<sockaddr_in> seeds;  // --seeds HOST:PORT[,...]: cluster nodes to locate topics at, after the server
+    vector<char*> pos;
+    for(int i=0;i<argc;++i){
+        string a=argv[i];
+        if(a=="--raw") raw=true;
+        else if(a=="--window" && i+1<argc) window=stoull(argv[++i]);
+        else if(a=="--nodelay" && i+1<argc) nodelay=string(argv[++i])!="off";
+        else if(a=="--ack" && i+1<argc) ack=argv[++i];
+        else if(a=="--threads" && i+1<argc) threads=max(1, stoi(argv[++i]));
+        else if(a=="--format" && i+1<argc){ if(!parse_out_fmt(argv[++i], fmt)){ cerr<<"Unknown --format "<<argv[i]<<"\n"; return 1; } }
+        else if(a=="--quiet") fmt=OUT_COUNT;
+        else if(a=="--out" && i+1<argc) out_path=argv[++i];
+        else if(a=="--file" && i+1<argc) pub_file=argv[++i];
+        else if(a=="--rate" && i+1<argc) bench.rate=stoull(argv[++i]);
+        else if(a=="--size" && i+1<argc) bench.size=(size_t)stoull(argv[++i]);
+        else if(a=="--topics" && i+1<argc) bench.topics=max(1, stoi(argv[++i]));
+        else if(a=="--count" && i+1<argc) bench.count=stoull(argv[++i]);
+        else if(a=="--seconds" && i+1<argc) bench.seconds=stod(argv[++i]);
+        else if(a=="--heartbeat" && i+1<argc) heartbeat=stod(argv[++i]);
+        else if(a=="--seq") sub_flags|=FLAG_SEQ;
+        else if(a=="--reliable"){ reliable=true; sub_flags|=FLAG_SEQ; }
+        else if(a=="--multicast") sub_flags|=FLAG_MCAST;
+        else if(a=="--compress" && i+1<argc){
+            string v=argv[++i];
+            codecs = v=="any" ? built_codecs() : codec_from_name(v);
+            if(!codec_supported(codecs & FLAG_LZ4 ? FLAG_LZ4 : codecs)){ cerr<<"--compress "<<v<<": not a codec built into this client\n"; return 1; }
+        }
+        else if(a=="--seeds" && i+1<argc){
+            string v=argv[++i];
+            for(size_t at=0; at<=v.size(); ){
+                size_t comma=min(v.find(',', at), v.size());
+                sockaddr_in sa; if(!parse_host_port(v.substr(at, comma-at), sa)){ cerr<<"--seeds takes IPv4 HOST:PORT[,HOST:PORT...]\n"; return 1; }
+                seeds.push_back(sa); at=comma+1;
+            }
+        }
+        else if(a=="--replay" && i+1<argc){
+            string v=argv[++i];
+            if(v=="last") sub_flags|=FLAG_REPLAY;
+            else{ sub_flags|=FLAG_REPLAY|FLAG_SEQ; if(v!="all") replay_from=max(1ULL, stoull(v)); }
+        }
+        else pos.push_back(argv[i]);
+    }
+    if(window==0) window=1;
+    if(ack!="each" && ack!="cumulative" && ack!="none"){ cerr<<"--ack must be each, cumulative or none\n"; return 1; }
+    int ack_flags = ack=="cumulative" ? FLAG_CUMACK : ack=="none" ? FLAG_NOACK : 0;
+    argc=(int)pos.size(); argv=pos.data();
+
     if(argc < 6){
         cerr<<"Usage:\n"
-            <<"  Subscriber (multi-topic): ./client <server_ip> <port> <tcp|udp> sub <topic1> [topic2 ...]\n"
-            <<"  Publisher (single topic): ./client <server_ip> <port> <tcp|udp> pub <topic>\n";
+            <<"  Subscriber (multi-topic): ./client <server_ip> <port> <tcp|udp> sub <topic1> [topic2 ...] [--raw]\n"
+            <<"                            topics are dot-separated; * matches one level, # any number (md.*.AAPL, md.#)\n"
+            <<"                            [--threads N] (udp; N workers share the socket, output order is not kept)\n"
+            <<"                            [--format text|raw|decoded|ndjson|binary|count] [--quiet] [--out FILE]\n"
+            <<"                            [--seq] (number MSGs per topic) [--replay last|all|N] (retained history first,\n"
+            <<"                            from seq N on; needs a server with --retain)\n"
+            <<"                            [--reliable] (udp: in-order per topic, NACKing gaps; server needs --udp-window)\n"
+            <<"                            [--multicast] (udp: join the groups the server maps topics to)\n"
+            <<"                            [--compress lz4|zstd|any] (accept compressed MSGs; udp gets lz4 only)\n"
+            <<"  Publisher (single topic): ./client <server_ip> <port> <tcp|udp> pub <topic> [--raw] [--window N]\n"
+            <<"                            [--ack each|cumulative|none] (cumulative needs tcp)\n"
+            <<"                            [--file PATH] (send the file as one message, up to "<<(MAX_PAYLOAD_LEN>>20)<<" MiB over tcp)\n"
+            <<"  Benchmark (same host):     ./client <server_ip> <port> <tcp|udp> bench-pub|bench-sub <topic> [--raw]\n"
+            <<"                            [--rate N] [--size B] [--topics K] [--count N | --seconds S]\n"
+            <<"  TCP options: --nodelay on|off (default on)\n"
+            <<"  sub/pub: --heartbeat S (PING interval for servers with --idle-timeout; default "<<DEFAULT_HEARTBEAT_S<<", 0 = off)\n"
+            <<"  Cluster: --seeds HOST:PORT[,...] (other nodes to ask where topics live if the server does not answer;\n"
+            <<"                            a tcp sub connects to each topic's owner, everything else to the first topic's)\n";
         return 1;
     }
     string ip=argv[1]; int port=stoi(argv[2]); string transport=argv[3]; string role=argv[4];
     bool use_udp = (transport=="udp");
     bool is_sub  = (role=="sub");
     bool is_pub  = (role=="pub");
-    if(!is_sub && !is_pub){ cerr<<"Role must be 'sub' or 'pub'\n"; return 1; }
+    bool bench_pub = (role=="bench-pub"), bench_sub = (role=="bench-sub");
+    if(!is_sub && !is_pub && !bench_pub && !bench_sub){ cerr<<"Role must be 'sub', 'pub', 'bench-pub' or 'bench-sub'\n"; return 1; }
+    if((bench_pub || bench_sub) && argc != 6){ cerr<<role<<" takes exactly one topic\n"; return 1; }
+    if(bench_pub && (window>1 || ack_flags)){ cerr<<"bench-pub always publishes without ACKs\n"; return 1; }
     if(transport!="tcp" && transport!="udp"){ cerr<<"Transport must be 'tcp' or 'udp'\n"; return 1; }
+    if(use_udp && window>1){ cerr<<"--window needs tcp\n"; return 1; }
+    if(use_udp && (ack_flags & FLAG_CUMACK)){ cerr<<"--ack cumulative needs tcp\n"; return 1; }
+    if(threads>1 && !(use_udp && is_sub)){ cerr<<"--threads needs a udp subscriber\n"; return 1; }
+    if((fmt!=OUT_TEXT || !out_path.empty()) && !is_sub){ cerr<<"--format, --quiet and --out are for subscribers\n"; return 1; }
+    if(sub_flags && !is_sub){ cerr<<"--seq, --replay, --reliable and --multicast are for subscribers\n"; return 1; }
+    if((sub_flags & FLAG_MCAST) && !use_udp){ cerr<<"--multicast needs udp\n"; return 1; }
+    if(codecs && !is_sub){ cerr<<"--compress is for subscribers\n"; return 1; }
+    if(codecs) sub_flags|=codecs|FLAG_RAW;   // compressed MSGs are raw ones
+    if(reliable && (!use_udp || threads>1)){ cerr<<"--reliable needs a single-threaded udp subscriber\n"; return 1; }
+    if(!pub_file.empty() && (!is_pub || window>1 || (ack_flags & FLAG_CUMACK))){ cerr<<"--file is for pub, one message at a time\n"; return 1; }
+    if(fmt==OUT_BINARY && out_path.empty()){ cerr<<"--format binary needs --out FILE\n"; return 1; }
+    // Machine-readable records on stdout: keep every status line off it.
+    bool data_on_stdout = is_sub && out_path.empty() && fmt!=OUT_TEXT && fmt!=OUT_COUNT;
+    ostream& info = data_on_stdout ? cerr : cout;
 
     // Common server sockaddr
     sockaddr_in srv{}; srv.sin_family=AF_INET; srv.sin_port=htons(port);
     if(inet_pton(AF_INET, ip.c_str(), &srv.sin_addr)!=1){ cerr<<"Invalid IP\n"; return 1; }
 
-    cout<<"[CLIENT] Transport="<< (use_udp ? "UDP" : "TCP")
-        <<", Role="<<(is_sub?"Subscriber":"Publisher")<<", Server="<<ip<<":"<<port<<"\n";
+    info<<"[CLIENT] Transport="<< (use_udp ? "UDP" : "TCP")
+        <<", Role="<<(is_sub?"Subscriber":is_pub?"Publisher":role)<<", Server="<<ip<<":"<<port<<"\n";
+
+    // Clustered: talk to the topics' owners. Any node takes any topic, but an
+    // owner saves the hop through it.
+    vector<string> topics; for(int i=5;i<argc;++i) topics.push_back(argv[i]);
+    vector<sockaddr_in> owners(topics.size(), srv);
+    if(!seeds.empty()){
+        seeds.insert(seeds.begin(), srv);
+        if(!locate_topics(seeds, topics, owners)){ cerr<<"[ERROR] no seed answered\n"; return 1; }
+        for(size_t i=0;i<topics.size();++i) info<<"[CLUSTER] '"<<topics[i]<<"' at "<<addr_str(owners[i])<<"\n";
+        if(!owners.empty()) srv=owners[0];
+    }
 
     // Create socket(s)
     int fd=-1;
+    TcpReader rd;   // every TCP receive goes through it, so read-ahead is never lost
+    UdpReader ur;   // the main thread's UDP receives
     if(use_udp){
         fd = socket(AF_INET, SOCK_DGRAM, 0);
         if(fd<0){ perror("socket UDP"); return 1; }
@@ -192,27 +864,79 @@ int main(int argc, char** argv){
         fd = socket(AF_INET, SOCK_STREAM, 0);
         if(fd<0){ perror("socket TCP"); return 1; }
         if(connect(fd,(sockaddr*)&srv,sizeof(srv))<0){ perror("connect"); return 1; }
-        cout<<"[TCP] Connected to "<<ip<<":"<<port<<"\n";
+        int nd=nodelay?1:0; setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nd, sizeof(nd));
+        info<<"[TCP] Connected to "<<addr_str(srv)<<"\n";
+    }
+
+    // ---- Benchmark subscriber ----
+    if(bench_sub){
+        bool ok=bench_subscribe(fd, use_udp, srv, argv[5], raw, bench, rd, ur);
+        // Leave the server's subscriber lists; for UDP nothing else would.
+        if(use_udp) (void)send_packet_udp(fd, srv, TYPE_TERM, argv[5], "");
+        else (void)send_packet_tcp(fd, TYPE_TERM, argv[5], "");
+        ::close(fd);
+        return ok ? 0 : 1;
     }
 
     // ---- Subscriber path ----
     if(is_sub){
-        vector<string> topics; for(int i=5;i<argc;++i) topics.push_back(argv[i]);
         if(topics.empty()){ cerr<<"Subscriber requires at least one topic\n"; return 1; }
 
+        FrameView f;  // reused by every receive below
+        int out_fd=1;
+        if(!out_path.empty() && (out_fd=open(out_path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644))<0){ perror("open --out"); return 1; }
+        OutputSink sink(out_fd, fmt==OUT_COUNT);
+        vector<MsgOut> outs(threads);
+        for(auto& o: outs){ o.sink=sink.add_producer(); o.fmt=fmt; o.status=data_on_stdout ? &cerr : !out_path.empty() ? &cout : nullptr; }
+        MsgOut& out=outs[0];   // the main thread's
+        // TCP to a cluster: one more connection, reader and output per further
+        // owner, each drained by its own thread.
+        struct OwnerConn { sockaddr_in to; int fd=-1; TcpReader rd; MsgOut out; };
+        deque<OwnerConn> others;
+        vector<OwnerConn*> conn_of(topics.size(), nullptr);   // null: the main connection
+        for(size_t i=0;i<topics.size() && !use_udp;++i){
+            if(same_addr(owners[i], srv)) continue;
+            for(auto& c: others) if(same_addr(c.to, owners[i])) conn_of[i]=&c;
+            if(conn_of[i]) continue;
+            others.emplace_back(); OwnerConn& c=others.back(); c.to=owners[i]; c.out=outs[0]; c.out.sink=sink.add_producer();
+            c.fd=socket(AF_INET, SOCK_STREAM, 0);
+            if(c.fd<0 || connect(c.fd,(sockaddr*)&c.to,sizeof(c.to))<0){ perror("connect"); return 1; }
+            int nd=nodelay?1:0; setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &nd, sizeof(nd));
+            info<<"[TCP] Connected to "<<addr_str(c.to)<<"\n";
+            conn_of[i]=&c;
+        }
+        ReliableRx rx{fd, srv, &out};
+        McastRx mc;
+        ReliableRx* rel=reliable ? &rx : nullptr;
+        if(reliable){ timeval tv{0, UDP_NACK_RETRY_MS*1000}; setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)); }
+        cout.flush();
+        sink.start();
+        int sub_type = TYPE_SUBSCRIBE | (raw ? FLAG_RAW : 0) | sub_flags;
+        auto ack_note=[&](const string& t, const char* via){
+            string s="[ACK] SUBSCRIBE confirmed for '"+t+"' via "+via;
+            if(raw && !(f.flags & FLAG_RAW)) s+=" (server sends Base64 only)";
+            if(codecs){
+                int c=f.flags & CODEC_MASK;
+                s+=c==CODEC_MASK ? " (compressed: lz4, zstd)" : c ? string(" (compressed: ")+codec_name(c)+")" : " (server does not compress)";
+            }
+            if(f.flags & FLAG_SEQ) s+=" at seq "+to_string(f.seq);
+            if(f.flags & FLAG_MCAST) s+=" (multicast "+McastRx::name(f.payload)+")";
+            out.note(s+"\n");
+        };
+
         // Send SUBSCRIBE for each topic and wait for ACK
-        for(const auto& t: topics){
+        for(size_t ti=0; ti<topics.size(); ++ti){
+            const string& t=topics[ti];
             bool ok=false;
-            if(use_udp){
-                if(!send_packet_udp(fd, srv, SUBSCRIBE, t, "")){
+            if(use_udp) for(int type=sub_type, again=1; again; ){   // again: resubscribe without FLAG_MCAST
+                again=0;
+                if(!send_packet_udp(fd, srv, type, t, "", replay_from)){
                     cerr<<"[ERROR] UDP send SUBSCRIBE '"<<t<<"' failed\n"; return 1;
                 }
                 // Because UDP can reorder, we may receive MSG first; loop until ACK arrives (or timeout overall)
                 auto start = chrono::steady_clock::now();
                 while(true){
-                    int ty; string tp, pl;
-                    sockaddr_in from{};
-                    if(!recv_packet_udp(fd, ty, tp, pl, &from)){
+                    if(!ur.next(fd, f)){
                         // timeout tick — check total wait
                         if(chrono::steady_clock::now() - start > chrono::seconds(5)){
                             cerr<<"[WARN] No ACK for SUBSCRIBE '"<<t<<"' within 5s (continuing to listen)\n";
@@ -220,118 +944,144 @@ int main(int argc, char** argv){
                         }
                         continue;
                     }
-                    if(ty==ACK){
-                        cout<<"[ACK] SUBSCRIBE confirmed for '"<<t<<"' via UDP\n";
+                    if(f.type==TYPE_ACK){
+                        if((f.flags & FLAG_MCAST) && !mc.join(f.payload)){
+                            // Subscribe again without it: the server then sends to us directly.
+                            out.note("[WARN] cannot join multicast group for '"+t+"' ("+strerror(errno)+"), using unicast\n");
+                            type&=~FLAG_MCAST; again=1; break;
+                        }
+                        ack_note(t, "UDP");
+                        // A replay follows with older seqs: start from its first MSG instead.
+                        if(rel && (f.flags & FLAG_SEQ) && !(sub_flags & FLAG_REPLAY)) rel->anchor(f.topic, f.seq);
                         ok=true; break;
-                    }else if(ty==MSG){
-                        string decoded; bool dec=b64_decode(pl, decoded);
-                        cout<<"[RECEIVED] Topic='"<<tp<<"' base64="<<pl<<" | text="<<(dec?decoded:"<b64-decode-error>")<<"\n";
+                    }else if(f.type==TYPE_MSG){
+                        if(rel) rel->on_msg(f, ReliableRx::Clock::now()); else out.msg(f);
                         // keep waiting for ACK
                     } // ignore others
                 }
             }else{
-                if(!send_packet_tcp(fd, SUBSCRIBE, t, "")){ cerr<<"[ERROR] TCP send SUBSCRIBE failed\n"; return 1; }
-                int ty; string tp, pl;
-                if(!recv_packet_tcp(fd, ty, tp, pl) || ty!=ACK){ cerr<<"[ERROR] No ACK for SUBSCRIBE '"<<t<<"'\n"; return 1; }
-                cout<<"[ACK] SUBSCRIBE confirmed for '"<<t<<"' via TCP\n";
+                OwnerConn* c=conn_of[ti];
+                int cfd=c ? c->fd : fd; TcpReader& crd=c ? c->rd : rd; MsgOut& o=c ? c->out : out;
+                if(!send_packet_tcp(cfd, sub_type, t, "", replay_from)){ cerr<<"[ERROR] TCP send SUBSCRIBE failed\n"; return 1; }
+                // Topics subscribed so far may already be sending (a replay, say).
+                bool got=false;
+                while((got=crd.next(cfd, f)) && f.type!=TYPE_ACK){
+                    if(f.type==TYPE_MSG) o.msg(f); else if(f.type==TYPE_DICT) dicts.add(f.payload);
+                }
+                if(!got){ cerr<<"[ERROR] No ACK for SUBSCRIBE '"<<t<<"'\n"; return 1; }
+                ack_note(t, "TCP");
                 ok=true;
             }
             (void)ok; // informational; we proceed to receive anyway
         }
 
-        cout<<"[READY] Subscribed to "<<topics.size()<<" topic(s). Waiting for messages...\n";
+        out.note("[READY] Subscribed to "+to_string(topics.size())+" topic(s). Waiting for messages...\n");
+        start_heartbeat(fd, use_udp, srv, heartbeat);
+        for(auto& c: others) start_heartbeat(c.fd, false, c.to, heartbeat);
 
         // Receive loop
         if(use_udp){
-            while(true){
-                int ty; string tp, pl;
-                if(!recv_packet_udp(fd, ty, tp, pl, nullptr)){
-                    // timeout just means no packets recently; continue listening
-                    continue;
-                }
-                if(ty==MSG){
-                    string decoded; bool ok=b64_decode(pl, decoded);
-                    cout<<"[RECEIVED] Topic='"<<tp<<"' base64="<<pl<<" | text="<<(ok?decoded:"<b64-decode-error>")<<"\n";
-                }else if(ty==ACK){
-                    // unsolicited ACK (e.g., from server after a prior action)
-                    cout<<"[ACK] (unsolicited UDP)\n";
-                }
-            }
+            // The kernel hands each datagram to one of the threads blocked on the socket.
+            vector<thread> workers;
+            for(int i=1;i<threads;++i) workers.emplace_back([fd, o=&outs[i]]{ UdpReader r; udp_receive_loop(fd, r, *o); });
+            udp_receive_loop(fd, ur, out, rel, &mc);
         }else{
-            while(true){
-                int ty; string tp, pl;
-                if(!recv_packet_tcp(fd, ty, tp, pl)){ cerr<<"[INFO] Server closed connection.\n"; break; }
-                if(ty==MSG){
-                    string decoded; bool ok=b64_decode(pl, decoded);
-                    cout<<"[RECEIVED] Topic='"<<tp<<"' base64="<<pl<<" | text="<<(ok?decoded:"<b64-decode-error>")<<"\n";
-                }else if(ty==ACK){
-                    cout<<"[ACK] (unsolicited TCP)\n";
-                }
-            }
+            vector<thread> readers;
+            for(auto& c: others) readers.emplace_back([&c]{ tcp_receive_loop(c.fd, c.rd, c.out); });
+            tcp_receive_loop(fd, rd, out);
+            for(auto& r: readers) r.join();
+            for(auto& c: others) ::close(c.fd);
         }
-        // never reached in normal sub mode; Ctrl+C to quit
+        // TCP only: every server closed, and the sink drains as it goes out of scope.
+        // UDP never gets here; Ctrl+C to quit
         ::close(fd);
         return 0;
     }
 
     // ---- Publisher path ----
-    if(is_pub){
+    if(is_pub || bench_pub){
         if(argc != 6){ cerr<<"Publisher requires exactly one topic\n"; return 1; }
         string topic=argv[5];
-        cout<<"[PUBLISHER READY] Topic='"<<topic<<"'. Type messages; Ctrl+D to quit.\n";
-        string line;
-        while(getline(cin, line)){
-            string enc = b64_encode(line);
-            bool sent=false, got_ack=false;
-
-            if(use_udp){
-                sent = send_packet_udp(fd, srv, PUBLISH, topic, enc);
-                if(!sent){ cerr<<"[ERROR] UDP send PUBLISH failed\n"; break; }
-                // Wait briefly for ACK (not guaranteed with UDP)
-                auto start = chrono::steady_clock::now();
-                while(true){
-                    int ty; string tp, pl;
-                    if(!recv_packet_udp(fd, ty, tp, pl, nullptr)){
-                        if(chrono::steady_clock::now() - start > chrono::seconds(3)){
-                            cerr<<"[WARN] No ACK for PUBLISH (UDP). Continuing.\n";
-                            break;
+        if(is_pub && !pub_file.empty()){
+            cout<<"[PUBLISHER READY] Topic='"<<topic<<"'. Sending "<<pub_file<<".\n";
+        }else if(is_pub){
+            cout<<"[PUBLISHER READY] Topic='"<<topic<<"'. Type messages; Ctrl+D to quit.\n";
+            start_heartbeat(fd, use_udp, srv, heartbeat);
+        }
+        FrameView f;
+        if(bench_pub){
+            if(!bench_publish(fd, use_udp, srv, topic, raw, bench)){ ::close(fd); return 1; }
+        }else if(!use_udp && (window>1 || ack_flags)){
+            if(!publish_pipelined(fd, rd, topic, raw, window, ack_flags)){ ::close(fd); return 1; }
+        }else{
+            string line; vector<char> b64;   // reused Base64 buffer
+            int pub_type=TYPE_PUBLISH | (raw ? FLAG_RAW : 0) | ack_flags;  // only FLAG_NOACK gets here
+            bool file_sent=false;
+            auto next_message=[&]{
+                if(pub_file.empty()) return (bool)getline(cin, line);
+                if(file_sent) return false;
+                file_sent=true;
+                if(!read_file(pub_file, line)){ cerr<<"[ERROR] cannot read "<<pub_file<<"\n"; return false; }
+                return true;
+            };
+            while(next_message()){
+                string_view enc=line;
+                if(!raw){
+                    b64.resize(b64_encoded_len(line.size()));
+                    enc=string_view(b64.data(), (size_t)b64_encode_into(line, b64.data(), b64.size()));
+                }
+                bool sent=false, got_ack=false;
+
+                if(enc.size()>MAX_PAYLOAD_LEN){ cerr<<"[ERROR] message over the "<<MAX_PAYLOAD_LEN<<"-byte payload limit\n"; break; }
+                if(use_udp && !fits_udp(topic, enc, pub_type)){ cerr<<"[ERROR] message too large for one datagram; use tcp\n"; break; }
+                if(use_udp){
+                    sent = send_packet_udp(fd, srv, pub_type, topic, enc);
+                    if(!sent){ cerr<<"[ERROR] UDP send PUBLISH failed\n"; break; }
+                    if(ack_flags & FLAG_NOACK){ cout<<"[SENT] PUBLISH (no ACK requested) via UDP\n"; continue; }
+                    // Wait briefly for ACK (not guaranteed with UDP)
+                    auto start = chrono::steady_clock::now();
+                    while(true){
+                        if(!ur.next(fd, f)){
+                            if(chrono::steady_clock::now() - start > chrono::seconds(3)){
+                                cerr<<"[WARN] No ACK for PUBLISH (UDP). Continuing.\n";
+                                break;
+                            }
+                            continue;
                         }
-                        continue;
+                        if(f.type==TYPE_ACK){ got_ack=true; break; }
+                        // If a MSG arrives here, we're a publisher, so ignore.
                     }
-                    if(ty==ACK){ got_ack=true; break; }
-                    // If a MSG arrives here, we're a publisher, so ignore.
+                }else{
+                    sent = send_packet_tcp(fd, pub_type, topic, enc);
+                    if(!sent){ cerr<<"[ERROR] TCP send PUBLISH failed\n"; break; }
+                    if(rd.next(fd, f) && f.type==TYPE_ACK) got_ack=true;
                 }
-            }else{
-                sent = send_packet_tcp(fd, PUBLISH, topic, enc);
-                if(!sent){ cerr<<"[ERROR] TCP send PUBLISH failed\n"; break; }
-                int ty; string tp, pl;
-                if(recv_packet_tcp(fd, ty, tp, pl) && ty==ACK) got_ack=true;
-            }
 
-            if(got_ack) cout<<"[ACK] PUBLISH confirmed (sent base64="<<enc<<") via "<<(use_udp?"UDP":"TCP")<<"\n";
-            else        cout<<"[INFO] PUBLISH sent; ACK not confirmed ("<<(use_udp?"UDP":"TCP")<<")\n";
+                if(got_ack && raw) cout<<"[ACK] PUBLISH confirmed (sent "<<enc.size()<<" raw bytes) via "<<(use_udp?"UDP":"TCP")<<"\n";
+                else if(got_ack && enc.size()>ECHO_MAX) cout<<"[ACK] PUBLISH confirmed (sent "<<enc.size()<<" Base64 bytes) via "<<(use_udp?"UDP":"TCP")<<"\n";
+                else if(got_ack) cout<<"[ACK] PUBLISH confirmed (sent base64="<<enc<<") via "<<(use_udp?"UDP":"TCP")<<"\n";
+                else        cout<<"[INFO] PUBLISH sent; ACK not confirmed ("<<(use_udp?"UDP":"TCP")<<")\n";
+            }
         }
 
         // graceful TERM
         if(use_udp){
-            (void)send_packet_udp(fd, srv, TERM, topic, "");
+            (void)send_packet_udp(fd, srv, TYPE_TERM, topic, "");
             // try to read an ACK briefly
             auto start = chrono::steady_clock::now();
             while(true){
-                int ty; string tp, pl;
-                if(!recv_packet_udp(fd, ty, tp, pl, nullptr)){
+                if(!ur.next(fd, f)){
                     if(chrono::steady_clock::now() - start > chrono::seconds(2)) break;
                     continue;
                 }
-                if(ty==ACK){
+                if(f.type==TYPE_ACK){
                     cout<<"[ACK] TERM confirmed via UDP\n";
                     break;
                 }
             }
         }else{
-            if(send_packet_tcp(fd, TERM, topic, "")){
-                int ty; string tp, pl;
-                if(recv_packet_tcp(fd, ty, tp, pl) && ty==ACK) cout<<"[ACK] TERM confirmed via TCP\n";
+            if(send_packet_tcp(fd, TYPE_TERM, topic, "")){
+                if(rd.next(fd, f) && f.type==TYPE_ACK) cout<<"[ACK] TERM confirmed via TCP\n";
             }
         }
 
@@ -0,0 +1,131 @@
+// epoch.h — Epoch-based reclamation for read-mostly shared data
+// Readers wrap their accesses in an EpochDomain::Guard, which is two stores
+// to a thread-private slot and never blocks. Writers unlink an object, then
+// retire() it; it is freed once every reader that could still see it has left.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class EpochDomain {
+public:
+    static const int kMaxThreads = 512;
+
+    class Guard {
+    public:
+        explicit Guard(EpochDomain& d) : d_(d) { d_.enter(); }
+        ~Guard() { d_.exit(); }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    private:
+        EpochDomain& d_;
+    };
+
+    ~EpochDomain() {
+        for (auto& r : retired_) r.del(r.p);
+    }
+
+    // Call after `p` is no longer reachable through any shared pointer.
+    template <class T>
+    void retire(T* p) {
+        retire_raw(p, [](void* q) { delete (T*)q; });
+    }
+
+    void retire_raw(void* p, void (*del)(void*)) {
+        std::vector<Retired> done;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            retired_.push_back({global_.fetch_add(1), p, del});
+            collect_locked(done);
+        }
+        for (auto& r : done) r.del(r.p);
+    }
+
+    // Frees whatever is already safe; retire() does this too.
+    void reclaim() {
+        std::vector<Retired> done;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            collect_locked(done);
+        }
+        for (auto& r : done) r.del(r.p);
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0};     // 0 = not inside a Guard
+        std::atomic<bool> used{false};
+    };
+    struct Retired {
+        uint64_t epoch;                     // epoch at which it was unlinked
+        void* p;
+        void (*del)(void*);
+    };
+    struct ThreadRec {
+        EpochDomain* domain;
+        Slot* slot;
+        int depth;
+        ~ThreadRec() { if (slot) slot->used.store(false, std::memory_order_release); }
+    };
+
+    ThreadRec& rec() {
+        static thread_local std::vector<ThreadRec> recs;
+        for (auto& r : recs)
+            if (r.domain == this) return r;
+        Slot* s = nullptr;
+        for (int i = 0; i < kMaxThreads && !s; ++i) {
+            bool expect = false;
+            if (slots_[i].used.compare_exchange_strong(expect, true)) {
+                s = &slots_[i];
+                int h = hwm_.load();
+                while (h <= i && !hwm_.compare_exchange_weak(h, i + 1)) {}
+            }
+        }
+        recs.push_back({this, s, 0});
+        return recs.back();
+    }
+
+    // Threads beyond kMaxThreads still work; while any of them is inside a
+    // Guard nothing is reclaimed.
+    void enter() {
+        ThreadRec& r = rec();
+        if (r.depth++ != 0) return;
+        if (r.slot) r.slot->epoch.store(global_.load());
+        else overflow_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit() {
+        ThreadRec& r = rec();
+        if (--r.depth != 0) return;
+        if (r.slot) r.slot->epoch.store(0, std::memory_order_release);
+        else overflow_.fetch_sub(1, std::memory_order_release);
+    }
+
+    // An object retired at epoch e can only be held by readers that entered at
+    // an epoch <= e; everything older than the oldest active reader is free.
+    void collect_locked(std::vector<Retired>& done) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t oldest = overflow_.load() ? 0 : UINT64_MAX;
+        int h = hwm_.load();
+        for (int i = 0; i < h; ++i) {
+            uint64_t e = slots_[i].epoch.load();
+            if (e && e < oldest) oldest = e;
+        }
+        size_t keep = 0;
+        for (size_t i = 0; i < retired_.size(); ++i) {
+            if (retired_[i].epoch < oldest) done.push_back(retired_[i]);
+            else retired_[keep++] = retired_[i];
+        }
+        retired_.resize(keep);
+    }
+
+    Slot slots_[kMaxThreads];
+    std::atomic<int> hwm_{0};
+    std::atomic<int> overflow_{0};
+    std::atomic<uint64_t> global_{1};
+    std::mutex mtx_;
+    std::vector<Retired> retired_;
+};
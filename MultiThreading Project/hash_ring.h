@@ -0,0 +1,58 @@
+// hash_ring.h — Consistent hashing of topic names onto cluster nodes
+// Every node is placed at HASH_RING_VNODES points of a 64-bit ring, hashed
+// from its id, and a key belongs to the node of the first point at or after
+// the key's own hash. Adding or removing a node only moves the keys on the
+// arcs it gains or loses, about 1/N of them, and the many points per node
+// keep each node's share close to even. The placement depends on nothing but
+// the ids, so every node configured with the same list agrees on every
+// owner without talking to the others.
+// Not synchronized: build it, then only call owner().
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define HASH_RING_VNODES 128
+
+class HashRing {
+public:
+    void add(uint32_t node, std::string_view id) {
+        for (uint32_t i = 0; i < HASH_RING_VNODES; ++i)
+            points_.push_back({hash(std::string(id) + '#' + std::to_string(i)), node});
+        std::sort(points_.begin(), points_.end(), [](const Point& a, const Point& b) {
+            return a.at != b.at ? a.at < b.at : a.node < b.node;
+        });
+    }
+
+    // The ring must not be empty.
+    uint32_t owner(std::string_view key) const {
+        uint64_t h = hash(key);
+        auto it = std::lower_bound(points_.begin(), points_.end(), h,
+                                   [](const Point& p, uint64_t v) { return p.at < v; });
+        return (it == points_.end() ? points_.front() : *it).node;
+    }
+
+    bool empty() const { return points_.empty(); }
+
+    // FNV-1a, finished with a 64-bit mixer so that keys differing only in
+    // their last bytes (md.1, md.2, ...) still land far apart.
+    static uint64_t hash(std::string_view s) {
+        uint64_t h = 1469598103934665603ull;
+        for (unsigned char c : s) h = (h ^ c) * 1099511628211ull;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+
+private:
+    struct Point {
+        uint64_t at;
+        uint32_t node;
+    };
+    std::vector<Point> points_;
+};
@@ -0,0 +1,101 @@
+// latency_histogram.h — Fixed-size log-linear histogram in the HDR style
+// Values below 2^HIST_SUB_BITS are counted exactly; above that every power
+// of two is split into 2^(HIST_SUB_BITS-1) equal buckets, so any recorded
+// value is reported within 1/128 (0.8%) of itself. Recording is one index
+// computation and one increment, with no allocation after construction.
+// Not synchronized: keep one per thread and merge() them for reporting.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define HIST_SUB_BITS 8
+#define HIST_SUB      (1u << HIST_SUB_BITS)
+#define HIST_HALF     (HIST_SUB / 2)
+#define HIST_BUCKETS  (HIST_SUB + (64 - HIST_SUB_BITS) * HIST_HALF)
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(HIST_BUCKETS) {}
+
+    void record(uint64_t v) {
+        counts_[index(v)]++;
+        total_++;
+        sum_ += v;
+        if (v > max_) max_ = v;
+        if (v < min_) min_ = v;
+    }
+
+    void merge(const LatencyHistogram& o) {
+        for (size_t i = 0; i < counts_.size(); ++i) counts_[i] += o.counts_[i];
+        total_ += o.total_;
+        sum_ += o.sum_;
+        if (o.max_ > max_) max_ = o.max_;
+        if (o.min_ < min_) min_ = o.min_;
+    }
+
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        total_ = sum_ = max_ = 0;
+        min_ = UINT64_MAX;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    double mean() const { return total_ ? (double)sum_ / (double)total_ : 0.0; }
+
+    // Smallest bucket bound that at least `pct` percent of the values fall
+    // under, capped at the exact maximum; 0 when empty.
+    uint64_t percentile(double pct) const {
+        if (!total_) return 0;
+        uint64_t want = (uint64_t)((pct / 100.0) * (double)total_ + 0.5);
+        if (want < 1) want = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= want) {
+                uint64_t hi = upper(i);
+                return hi < max_ ? hi : max_;
+            }
+        }
+        return max_;
+    }
+
+private:
+    static int msb(uint64_t v) {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanReverse64(&i, v);
+        return (int)i;
+#else
+        return 63 - __builtin_clzll(v);
+#endif
+    }
+
+    static size_t index(uint64_t v) {
+        if (v < HIST_SUB) return (size_t)v;
+        int e = msb(v) - HIST_SUB_BITS + 1;             // >= 1
+        uint64_t sub = v >> e;                          // in [HIST_HALF, HIST_SUB)
+        return HIST_SUB + (size_t)(e - 1) * HIST_HALF + (size_t)(sub - HIST_HALF);
+    }
+
+    // Largest value that maps to bucket i.
+    static uint64_t upper(size_t i) {
+        if (i < HIST_SUB) return i;
+        size_t e = (i - HIST_SUB) / HIST_HALF + 1;
+        uint64_t sub = (i - HIST_SUB) % HIST_HALF + HIST_HALF;
+        return ((sub + 1) << e) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+    uint64_t min_ = UINT64_MAX;
+};
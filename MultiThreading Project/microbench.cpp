@@ -0,0 +1,343 @@
+// microbench.cpp — Google Benchmark suite for the hot paths
+// Covers Base64 (the dispatched SIMD kernel against the scalar code),
+// frame parsing and serialization, the client's gathered sends against the
+// copy-and-send they replaced (over socketpairs, so no network is involved),
+// and the server's fan-out path with 1 to 100k subscribers on one topic.
+// Build: cmake builds it as `microbench` when Google Benchmark is installed.
+// Run:   ./microbench [--benchmark_filter=B64] ; B64_KERNEL=scalar|sse41|... picks the kernel.
+#include <benchmark/benchmark.h>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "base64.h"
+#include "epoch.h"
+#include "outbound_queue.h"
+#include "protocol.h"
+#include "shared_frame.h"
+#include "topic_registry.h"
+#include "topic_trie.h"
+
+using namespace std;
+
+static string payload_of(size_t n) {
+    string s(n, '\0');
+    for (size_t i = 0; i < n; ++i) s[i] = (char)(i * 131 + 7);
+    return s;
+}
+
+static const string kTopic = "bench.topic";
+
+#define PAYLOAD_SIZES ->Arg(16)->Arg(64)->Arg(256)->Arg(1024)->Arg(4096)->Arg(65536)
+
+// ----- Base64 -----
+static void BM_B64Encode(benchmark::State& st) {
+    string in = payload_of((size_t)st.range(0));
+    vector<char> out(b64_encoded_len(in.size()));
+    for (auto _ : st) {
+        benchmark::DoNotOptimize(b64_encode_into(in, out.data(), out.size()));
+        benchmark::ClobberMemory();
+    }
+    st.SetBytesProcessed((int64_t)st.iterations() * (int64_t)in.size());
+    st.SetLabel(b64_kernel_name());
+}
+BENCHMARK(BM_B64Encode) PAYLOAD_SIZES;
+
+static void BM_B64EncodeScalar(benchmark::State& st) {
+    string in = payload_of((size_t)st.range(0));
+    vector<char> out(b64_encoded_len(in.size()));
+    for (auto _ : st) {
+        b64_encode_scalar((const unsigned char*)in.data(), in.size(), out.data());
+        benchmark::ClobberMemory();
+    }
+    st.SetBytesProcessed((int64_t)st.iterations() * (int64_t)in.size());
+}
+BENCHMARK(BM_B64EncodeScalar) PAYLOAD_SIZES;
+
+// The allocating std::string wrapper, for comparison with _into.
+static void BM_B64EncodeString(benchmark::State& st) {
+    string in = payload_of((size_t)st.range(0));
+    for (auto _ : st) benchmark::DoNotOptimize(b64_encode(in));
+    st.SetBytesProcessed((int64_t)st.iterations() * (int64_t)in.size());
+}
+BENCHMARK(BM_B64EncodeString) PAYLOAD_SIZES;
+
+static void BM_B64Decode(benchmark::State& st) {
+    string in = b64_encode(payload_of((size_t)st.range(0)));
+    vector<char> out(b64_decoded_max(in.size()));
+    for (auto _ : st) {
+        benchmark::DoNotOptimize(b64_decode_into(in, out.data(), out.size()));
+        benchmark::ClobberMemory();
+    }
+    st.SetBytesProcessed((int64_t)st.iterations() * (int64_t)st.range(0));
+    st.SetLabel(b64_kernel_name());
+}
+BENCHMARK(BM_B64Decode) PAYLOAD_SIZES;
+
+static void BM_B64DecodeScalar(benchmark::State& st) {
+    string in = b64_encode(payload_of((size_t)st.range(0)));
+    vector<char> out(b64_decoded_max(in.size()));
+    for (auto _ : st) {
+        benchmark::DoNotOptimize(b64_decode_scalar(in.data(), in.size(), out.data()));
+        benchmark::ClobberMemory();
+    }
+    st.SetBytesProcessed((int64_t)st.iterations() * (int64_t)st.range(0));
+}
+BENCHMARK(BM_B64DecodeScalar) PAYLOAD_SIZES;
+
+static void BM_B64DecodeString(benchmark::State& st) {
+    string in = b64_encode(payload_of((size_t)st.range(0)));
+    string out;
+    for (auto _ : st) benchmark::DoNotOptimize(b64_decode(in, out));
+    st.SetBytesProcessed((int64_t)st.iterations() * (int64_t)st.range(0));
+}
+BENCHMARK(BM_B64DecodeString) PAYLOAD_SIZES;
+
+// ----- Framing -----
+#define FRAMES_PER_BUFFER 64
+
+// parse_frame over a buffer of back-to-back frames, as the server's and the
+// client's receive paths walk their read buffers.
+static void BM_ParseFrame(benchmark::State& st) {
+    string pl = payload_of((size_t)st.range(0));
+    vector<char> buf;
+    for (int i = 0; i < FRAMES_PER_BUFFER; ++i) encode_frame(buf, TYPE_MSG | FLAG_RAW, "bench.topic", pl);
+    for (auto _ : st) {
+        size_t off = 0;
+        FrameView f;
+        while (off < buf.size()) {
+            long used = parse_frame(buf.data() + off, buf.size() - off, f);
+            benchmark::DoNotOptimize(f);
+            off += (size_t)used;
+        }
+    }
+    st.SetItemsProcessed((int64_t)st.iterations() * FRAMES_PER_BUFFER);
+}
+BENCHMARK(BM_ParseFrame)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_EncodeFrame(benchmark::State& st) {
+    string pl = payload_of((size_t)st.range(0));
+    vector<char> buf;
+    for (auto _ : st) {
+        buf.clear();
+        encode_frame(buf, TYPE_PUBLISH | FLAG_SEQ, "bench.topic", pl, 42);
+        benchmark::DoNotOptimize(buf.data());
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_EncodeFrame)->Arg(16)->Arg(256)->Arg(4096);
+
+// A shared frame from the thread's SlabPool, against the same block size
+// from the general heap.
+static void BM_FrameRefPooled(benchmark::State& st) {
+    string pl = payload_of((size_t)st.range(0));
+    for (auto _ : st) {
+        FrameRef f = FrameRef::encode(TYPE_MSG | FLAG_RAW, kTopic, pl);
+        benchmark::DoNotOptimize(f.data());
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_FrameRefPooled)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_FrameHeap(benchmark::State& st) {
+    string pl = payload_of((size_t)st.range(0));
+    size_t n = 16 + frame_size(kTopic.size(), pl.size());
+    for (auto _ : st) {
+        char* p = (char*)::operator new(n);
+        char* q = write_head(p + 16, TYPE_MSG | FLAG_RAW, kTopic.size(), pl.size());
+        memcpy(q, kTopic.data(), kTopic.size());
+        memcpy(q + kTopic.size(), pl.data(), pl.size());
+        benchmark::DoNotOptimize(p);
+        ::operator delete(p);
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_FrameHeap)->Arg(16)->Arg(256)->Arg(4096);
+
+// ----- Client sends, over a socketpair -----
+// Each iteration sends one frame and reads it back on the other end, so the
+// receive cost is common to both variants and the difference is the send.
+struct SockPair {
+    int fd[2];
+    explicit SockPair(int type) { socketpair(AF_UNIX, type, 0, fd); }
+    ~SockPair() { close(fd[0]); close(fd[1]); }
+};
+
+static void drain(int fd, vector<char>& sink, size_t n) {
+    while (n) {
+        ssize_t r = recv(fd, sink.data(), min(n, sink.size()), 0);
+        if (r <= 0) return;
+        n -= (size_t)r;
+    }
+}
+
+// Datagram, as send_packet_udp does it now: header on the stack, one sendmsg.
+static void BM_SendDatagramGather(benchmark::State& st) {
+    SockPair sp(SOCK_DGRAM);
+    string pl = payload_of((size_t)st.range(0));
+    vector<char> sink(1 << 17);
+    for (auto _ : st) {
+        char head[sizeof(Header) + 8];
+        iovec iov[3];
+        size_t hn = (size_t)(write_head(head, TYPE_PUBLISH, kTopic.size(), pl.size()) - head);
+        iov[0] = {head, hn};
+        iov[1] = {(void*)kTopic.data(), kTopic.size()};
+        iov[2] = {(void*)pl.data(), pl.size()};
+        msghdr m{};
+        m.msg_iov = iov;
+        m.msg_iovlen = 3;
+        sendmsg(sp.fd[0], &m, 0);
+        recv(sp.fd[1], sink.data(), sink.size(), 0);
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_SendDatagramGather)->Arg(16)->Arg(256)->Arg(4096);
+
+// Datagram, as send_packet_udp used to: copy into a fresh vector, then send.
+static void BM_SendDatagramCopy(benchmark::State& st) {
+    SockPair sp(SOCK_DGRAM);
+    string pl = payload_of((size_t)st.range(0));
+    vector<char> sink(1 << 17);
+    for (auto _ : st) {
+        vector<char> buf;
+        buf.reserve(sizeof(Header) + kTopic.size() + pl.size());
+        buf.resize(sizeof(Header));
+        write_header(buf.data(), TYPE_PUBLISH, kTopic.size(), pl.size());
+        buf.insert(buf.end(), kTopic.begin(), kTopic.end());
+        buf.insert(buf.end(), pl.begin(), pl.end());
+        send(sp.fd[0], buf.data(), buf.size(), 0);
+        recv(sp.fd[1], sink.data(), sink.size(), 0);
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_SendDatagramCopy)->Arg(16)->Arg(256)->Arg(4096);
+
+// Stream, as send_packet_tcp does it now.
+static void BM_SendStreamGather(benchmark::State& st) {
+    SockPair sp(SOCK_STREAM);
+    string pl = payload_of((size_t)st.range(0));
+    vector<char> sink(1 << 17);
+    for (auto _ : st) {
+        char head[sizeof(Header) + 8];
+        iovec iov[3];
+        size_t hn = (size_t)(write_head(head, TYPE_PUBLISH, kTopic.size(), pl.size()) - head);
+        iov[0] = {head, hn};
+        iov[1] = {(void*)kTopic.data(), kTopic.size()};
+        iov[2] = {(void*)pl.data(), pl.size()};
+        msghdr m{};
+        m.msg_iov = iov;
+        m.msg_iovlen = 3;
+        sendmsg(sp.fd[0], &m, MSG_NOSIGNAL);
+        drain(sp.fd[1], sink, hn + kTopic.size() + pl.size());
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_SendStreamGather)->Arg(16)->Arg(256)->Arg(4096);
+
+// Stream, as send_packet_tcp used to: header, topic and payload sent separately.
+static void BM_SendStreamThreeSends(benchmark::State& st) {
+    SockPair sp(SOCK_STREAM);
+    string pl = payload_of((size_t)st.range(0));
+    vector<char> sink(1 << 17);
+    for (auto _ : st) {
+        char head[sizeof(Header)];
+        write_header(head, TYPE_PUBLISH, kTopic.size(), pl.size());
+        send(sp.fd[0], head, sizeof(head), MSG_NOSIGNAL);
+        send(sp.fd[0], kTopic.data(), kTopic.size(), MSG_NOSIGNAL);
+        send(sp.fd[0], pl.data(), pl.size(), MSG_NOSIGNAL);
+        drain(sp.fd[1], sink, sizeof(head) + kTopic.size() + pl.size());
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_SendStreamThreeSends)->Arg(16)->Arg(256)->Arg(4096);
+
+// ----- Server fan-out -----
+// A TCP subscriber as the server sees it, minus the socket.
+struct MockConn : Subscriber {
+    mutex out_mtx;
+    OutboundQueue<FrameRef> out{1024};
+};
+
+struct FanOutFixture {
+    EpochDomain epoch;
+    TopicRegistry registry{epoch};
+    vector<unique_ptr<MockConn>> subs;
+    TopicRegistry::Topic* topic;
+
+    explicit FanOutFixture(size_t n) {
+        topic = registry.intern(kTopic);
+        for (size_t i = 0; i < n; ++i) {
+            subs.push_back(unique_ptr<MockConn>(new MockConn));
+            registry.subscribe(subs.back().get(), topic->id);
+        }
+        registry.publish(topic->id);
+    }
+};
+
+// One publish: encode the frame once, walk the topic's snapshot under an
+// epoch guard and queue a shared reference per subscriber under its lock,
+// as the server's fan_out/conn_send do. The pop stands in for the owner
+// loop's flush, so queues stay short.
+static void BM_FanOut(benchmark::State& st) {
+    FanOutFixture fx((size_t)st.range(0));
+    string pl = payload_of(64);
+    for (auto _ : st) {
+        FrameRef f = FrameRef::encode(TYPE_MSG | FLAG_RAW, kTopic, pl);
+        {
+            EpochDomain::Guard g(fx.epoch);
+            const SubscriberList* list = fx.topic->snapshot.load(memory_order_acquire);
+            for (Subscriber* s : list->subs) {
+                MockConn* c = static_cast<MockConn*>(s);
+                lock_guard<mutex> lock(c->out_mtx);
+                c->out.push(f, OverflowPolicy::DropOldest);
+            }
+        }
+        for (auto& c : fx.subs) {
+            lock_guard<mutex> lock(c->out_mtx);
+            FrameRef done;
+            c->out.pop(done);
+        }
+    }
+    st.SetItemsProcessed((int64_t)st.iterations() * st.range(0));
+    st.counters["subscribers"] = (double)st.range(0);
+}
+BENCHMARK(BM_FanOut)->RangeMultiplier(10)->Range(1, 100000)->Unit(benchmark::kMicrosecond);
+
+// What a burst of subscribes costs a topic: one snapshot copy.
+static void BM_SnapshotPublish(benchmark::State& st) {
+    FanOutFixture fx((size_t)st.range(0));
+    for (auto _ : st) fx.registry.publish(fx.topic->id);
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_SnapshotPublish)->RangeMultiplier(10)->Range(1, 100000)->Unit(benchmark::kMicrosecond);
+
+// Pattern matching for one published topic against N wildcard patterns
+// ("md.<i>.*", "md.*.<i>", "feed.<i>.#"): the trie walk only visits the
+// branches the topic's levels select, so this should stay flat in N.
+static void BM_TrieMatch(benchmark::State& st) {
+    TopicTrie trie;
+    uint32_t id = 0;
+    for (int64_t i = 0; i < st.range(0); ++i) {
+        string n = to_string(i);
+        trie.insert("md." + n + ".*", id++);
+        trie.insert("md.*." + n, id++);
+        trie.insert("feed." + n + ".#", id++);
+    }
+    vector<uint32_t> out;
+    for (auto _ : st) {
+        trie.match("md.42.42", out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    st.SetItemsProcessed((int64_t)st.iterations());
+}
+BENCHMARK(BM_TrieMatch)->RangeMultiplier(10)->Range(100, 100000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,196 @@
+// net.h — Thin socket layer over Winsock and POSIX sockets
+// Everything above this header uses sock_t, INVALID_SOCK, close_socket and
+// the last_error_* predicates instead of the platform's own spellings, so
+// the same server source builds with MSVC/MinGW and natively on Linux.
+#pragma once
+
+#include <cstddef>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET sock_t;
+#define INVALID_SOCK INVALID_SOCKET
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+typedef int sock_t;
+#define INVALID_SOCK (-1)
+#endif
+
+// Process-wide setup and teardown: Winsock start-up on Windows; on POSIX,
+// SIGPIPE is ignored so a write to a dead peer is an EPIPE error, not a kill.
+inline bool net_init() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+#endif
+}
+
+inline void net_cleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+inline bool set_nonblocking(sock_t s) {
+#ifdef _WIN32
+    u_long on = 1;
+    return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+    int fl = fcntl(s, F_GETFL, 0);
+    return fl >= 0 && fcntl(s, F_SETFL, fl | O_NONBLOCK) == 0;
+#endif
+}
+
+// Lets a restarted server bind its port while old connections sit in
+// TIME_WAIT. Not set on Windows, where SO_REUSEADDR allows port hijacking.
+inline void set_reuse_addr(sock_t s) {
+#ifndef _WIN32
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#else
+    (void)s;
+#endif
+}
+
+// Linux spreads incoming connections across all listeners bound to one port
+// with SO_REUSEPORT. Other systems either lack the option or hand every
+// connection to one socket, so sharding is only enabled here.
+#ifdef __linux__
+#define NET_HAVE_REUSEPORT_LB 1
+#endif
+
+inline bool set_reuse_port(sock_t s) {
+#ifdef NET_HAVE_REUSEPORT_LB
+    int on = 1;
+    return setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == 0;
+#else
+    (void)s;
+    return false;
+#endif
+}
+
+inline bool last_error_would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+inline bool last_error_interrupted() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEINTR;
+#else
+    return errno == EINTR;
+#endif
+}
+
+// A non-blocking connect() that is still under way.
+inline bool last_error_in_progress() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS;
+#endif
+}
+
+// The outcome of a non-blocking connect() once the socket turns writable:
+// 0 if it connected, else the error it failed with.
+inline int pending_error(sock_t s) {
+    int e = 0;
+#ifdef _WIN32
+    int len = sizeof(e);
+#else
+    socklen_t len = sizeof(e);
+#endif
+    if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&e, &len) != 0) return -1;
+    return e;
+}
+
+inline void set_nodelay(sock_t s) {
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+inline void close_socket(sock_t s) {
+#ifdef _WIN32
+    closesocket(s);
+#else
+    ::close(s);
+#endif
+}
+
+// Linux (4.14+) can send straight from user pages with MSG_ZEROCOPY. The
+// bytes must then stay untouched until the kernel reports the send done on
+// the socket's error queue; reap_zerocopy() reads those reports.
+#if !defined(_WIN32) && defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define NET_HAVE_ZEROCOPY 1
+#include <linux/errqueue.h>
+#endif
+
+inline bool set_zerocopy(sock_t s) {
+#ifdef NET_HAVE_ZEROCOPY
+    int on = 1;
+    return setsockopt(s, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+#else
+    (void)s;
+    return false;
+#endif
+}
+
+#ifdef NET_HAVE_ZEROCOPY
+// Calls done(lo, hi, copied) for each completed range of zerocopy send
+// calls, numbered from 0 per socket; `copied` means the kernel fell back to
+// copying (as it does over loopback). Returns once the queue is empty.
+template <class Fn>
+inline void reap_zerocopy(sock_t s, Fn&& done) {
+    while (true) {
+        char control[128];
+        msghdr m{};
+        m.msg_control = control;
+        m.msg_controllen = sizeof(control);
+        if (recvmsg(s, &m, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&m); c; c = CMSG_NXTHDR(&m, c)) {
+            if (!((c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR) ||
+                  (c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR)))
+                continue;
+            const sock_extended_err* e = (const sock_extended_err*)CMSG_DATA(c);
+            if (e->ee_errno == 0 && e->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+                done(e->ee_info, e->ee_data, (e->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+        }
+    }
+}
+#endif
+
+// Gather-send: one syscall for several buffers.
+#ifdef _WIN32
+typedef WSABUF IoVec;
+inline void iovec_set(IoVec& v, const char* p, size_t n) { v.buf = (char*)p; v.len = (ULONG)n; }
+inline long send_iov(sock_t s, IoVec* v, int n) {
+    DWORD sent = 0;
+    if (WSASend(s, v, (DWORD)n, &sent, 0, NULL, NULL) != 0) return -1;
+    return (long)sent;
+}
+#else
+typedef struct iovec IoVec;
+inline void iovec_set(IoVec& v, const char* p, size_t n) { v.iov_base = (void*)p; v.iov_len = n; }
+inline long send_iov(sock_t s, IoVec* v, int n, int flags = 0) {
+    msghdr m{};
+    m.msg_iov = v;
+    m.msg_iovlen = (size_t)n;
+    return (long)sendmsg(s, &m, MSG_NOSIGNAL | flags);
+}
+#endif
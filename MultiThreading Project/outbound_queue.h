@@ -0,0 +1,101 @@
+// outbound_queue.h — Bounded per-subscriber send queue with an overflow policy
+// Publishers push into a subscriber's queue and return immediately; the
+// subscriber's event loop drains it as the socket accepts data. When a slow
+// subscriber lets its queue fill, the policy decides what gives.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class OverflowPolicy { DropOldest, DropNewest, Disconnect };
+
+inline bool parse_overflow_policy(const std::string& s, OverflowPolicy& p) {
+    if (s == "drop-oldest") p = OverflowPolicy::DropOldest;
+    else if (s == "drop-newest") p = OverflowPolicy::DropNewest;
+    else if (s == "disconnect") p = OverflowPolicy::Disconnect;
+    else return false;
+    return true;
+}
+
+// Ring buffer of frames. Not synchronized: the owner guards it with its own
+// lock. Only data frames count against `limit`; control frames (ACKs) are
+// always queued and never dropped, so a publisher cannot lose its ACK to a
+// policy meant for fan-out traffic.
+template <class T>
+class OutboundQueue {
+public:
+    enum PushResult { Queued, DroppedOldest, DroppedNewest, Overflow };
+
+    explicit OutboundQueue(size_t limit) : limit_(limit ? limit : 1) {}
+
+    PushResult push(T item, OverflowPolicy policy, bool control = false) {
+        PushResult r = Queued;
+        if (!control && data_ >= limit_) {
+            if (policy == OverflowPolicy::DropNewest) return DroppedNewest;
+            if (policy == OverflowPolicy::Disconnect) return Overflow;
+            drop_oldest_data();
+            r = DroppedOldest;
+        }
+        if (count_ == ring_.size()) grow();
+        Slot& s = ring_[(head_ + count_) & (ring_.size() - 1)];
+        s.item = std::move(item);
+        s.control = control;
+        ++count_;
+        if (!control) ++data_;
+        return r;
+    }
+
+    bool pop(T& out) {
+        if (!count_) return false;
+        Slot& s = ring_[head_];
+        out = std::move(s.item);
+        s.item = T();
+        if (!s.control) --data_;
+        head_ = (head_ + 1) & (ring_.size() - 1);
+        --count_;
+        return true;
+    }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+
+    void clear() {
+        T tmp;
+        while (pop(tmp)) {}
+    }
+
+private:
+    struct Slot {
+        T item;
+        bool control = false;
+    };
+
+    // Capacity grows by doubling up to what the traffic needs, so idle
+    // connections do not pay for `limit` slots up front.
+    void grow() {
+        size_t cap = ring_.empty() ? 16 : ring_.size() * 2;
+        std::vector<Slot> next(cap);
+        for (size_t i = 0; i < count_; ++i)
+            next[i] = std::move(ring_[(head_ + i) & (ring_.size() - 1)]);
+        ring_.swap(next);
+        head_ = 0;
+    }
+
+    // Usually the head; control frames ahead of it are kept in order.
+    void drop_oldest_data() {
+        size_t mask = ring_.size() - 1, i = 0;
+        while (ring_[(head_ + i) & mask].control) ++i;
+        for (; i > 0; --i)
+            ring_[(head_ + i) & mask] = std::move(ring_[(head_ + i - 1) & mask]);
+        ring_[head_].item = T();
+        head_ = (head_ + 1) & mask;
+        --count_;
+        --data_;
+    }
+
+    std::vector<Slot> ring_;
+    size_t head_ = 0, count_ = 0, data_ = 0;
+    size_t limit_;
+};
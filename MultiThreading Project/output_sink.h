@@ -0,0 +1,172 @@
+// output_sink.h — Asynchronous, batched output for the subscriber
+// Each receiving thread appends finished records to its own lock-free
+// single-producer/single-consumer byte ring and goes straight back to the
+// socket. One writer thread drains every ring with a single writev per round,
+// so the console or file write happens in large blocks and never stalls the
+// receive loops. A record becomes visible only once it is complete, so
+// records from different rings never interleave, unless a record is larger than
+// a ring (only TCP messages can be): that one goes out in ring-sized pieces.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SINK_RING_BYTES  (4u << 20)   // per producer; power of two
+#define SINK_IDLE_US     500          // writer back-off while every ring is empty
+#define SINK_REPORT_MS   1000         // count-only mode: interval between totals
+
+// Byte ring with free-running head/tail counters. push() is for the one
+// producer thread, readable()/consume() for the one consumer thread.
+class SpscByteRing {
+public:
+    explicit SpscByteRing(size_t cap) : buf_(cap), mask_(cap - 1) {}
+
+    // Waits (yielding) while the ring is too full: a writer that cannot keep
+    // up slows the producer down instead of losing output. A record larger
+    // than the ring is pushed in ring-sized pieces.
+    void push(std::string_view rec) {
+        for (; rec.size() > buf_.size(); rec.remove_prefix(buf_.size())) push(rec.substr(0, buf_.size()));
+        size_t n = rec.size();
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        while (buf_.size() - (tail - head_.load(std::memory_order_acquire)) < n)
+            std::this_thread::yield();
+        size_t at = tail & mask_, first = std::min(n, buf_.size() - at);
+        memcpy(buf_.data() + at, rec.data(), first);
+        memcpy(buf_.data(), rec.data() + first, n - first);
+        tail_.store(tail + n, std::memory_order_release);
+    }
+
+    // Fills up to two iovecs with the committed bytes; returns how many bytes.
+    size_t readable(iovec* iov, int& n) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t len = tail_.load(std::memory_order_acquire) - head;
+        if (!len) return 0;
+        size_t at = head & mask_, first = std::min(len, buf_.size() - at);
+        iov[n].iov_base = buf_.data() + at;
+        iov[n++].iov_len = first;
+        if (first < len) {
+            iov[n].iov_base = buf_.data();
+            iov[n++].iov_len = len - first;
+        }
+        return len;
+    }
+
+    void consume(size_t n) { head_.store(head_.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+private:
+    std::vector<char> buf_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0};   // consumer
+    alignas(64) std::atomic<size_t> tail_{0};   // producer
+};
+
+class OutputSink {
+public:
+    // One per receiving thread.
+    class Producer {
+    public:
+        void push(std::string_view rec) { ring_.push(rec); }
+        // Single writer, so a plain load/store pair instead of a locked add.
+        void count_one() { count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+        uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    private:
+        SpscByteRing ring_{SINK_RING_BYTES};
+        std::atomic<uint64_t> count_{0};
+        friend class OutputSink;
+    };
+
+    // Writes to `fd`. With count_only the writer also reports the total of
+    // count_one() calls every SINK_REPORT_MS and once more at stop().
+    OutputSink(int fd, bool count_only) : fd_(fd), count_only_(count_only) {}
+    ~OutputSink() { stop(); }
+
+    // Call before start().
+    Producer* add_producer() {
+        producers_.push_back(std::unique_ptr<Producer>(new Producer));
+        return producers_.back().get();
+    }
+
+    void start() { writer_ = std::thread([this] { run(); }); }
+
+    // Writes out everything pushed before the call, then joins the writer.
+    void stop() {
+        if (!writer_.joinable()) return;
+        stop_.store(true, std::memory_order_release);
+        writer_.join();
+    }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (auto& p : producers_) n += p->count();
+        return n;
+    }
+
+private:
+    void run() {
+        std::vector<iovec> iov(2 * producers_.size());
+        std::vector<size_t> took(producers_.size());
+        auto last = std::chrono::steady_clock::now();
+        uint64_t reported = 0;
+        while (true) {
+            // Read the flag first: whatever was pushed before stop() is then visible below.
+            bool stopping = stop_.load(std::memory_order_acquire);
+            int n = 0;
+            size_t total = 0;
+            for (size_t i = 0; i < producers_.size(); ++i) total += took[i] = producers_[i]->ring_.readable(iov.data(), n);
+            if (total) write_all(iov.data(), n);
+            for (size_t i = 0; i < producers_.size(); ++i) if (took[i]) producers_[i]->ring_.consume(took[i]);
+            auto now = std::chrono::steady_clock::now();
+            if (count_only_ && (stopping || now - last >= std::chrono::milliseconds(SINK_REPORT_MS))) {
+                uint64_t c = count();
+                double secs = std::chrono::duration<double>(now - last).count();
+                if (c != reported || stopping) report(c, stopping ? 0 : (uint64_t)((c - reported) / secs));
+                reported = c;
+                last = now;
+            }
+            if (stopping) return;
+            if (!total) std::this_thread::sleep_for(std::chrono::microseconds(SINK_IDLE_US));
+        }
+    }
+
+    // Output that cannot be written (closed pipe, full disk) is dropped.
+    void write_all(iovec* iov, int n) {
+        while (n) {
+            ssize_t w = writev(fd_, iov, n);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            while (n && (size_t)w >= iov->iov_len) { w -= (ssize_t)iov->iov_len; ++iov; --n; }
+            if (n) { iov->iov_base = (char*)iov->iov_base + w; iov->iov_len -= (size_t)w; }
+        }
+    }
+
+    void report(uint64_t total, uint64_t rate) {
+        char line[96];
+        int len = rate ? snprintf(line, sizeof(line), "[COUNT] %llu messages (%llu msgs/s)\n",
+                                  (unsigned long long)total, (unsigned long long)rate)
+                       : snprintf(line, sizeof(line), "[COUNT] %llu messages\n", (unsigned long long)total);
+        iovec v{line, (size_t)len};
+        write_all(&v, 1);
+    }
+
+    int fd_;
+    bool count_only_;
+    std::vector<std::unique_ptr<Producer>> producers_;
+    std::atomic<bool> stop_{false};
+    std::thread writer_;
+};
@@ -0,0 +1,203 @@
+// payload_codec.h — Optional LZ4 and zstd compression of MSG payloads
+// A compressed MSG is a raw one (FLAG_RAW) with FLAG_LZ4 or FLAG_ZSTD in its
+// type word; its payload is the message's length (32-bit, network order)
+// followed by the codec's output. The length lets a receiver size its buffer,
+// and refuse anything over MAX_PAYLOAD_LEN, before it decodes a byte.
+//
+// A zstd payload may be compressed against a dictionary trained on the
+// topic's own traffic. The zstd frame names the dictionary by id, and the
+// server sends the dictionary itself (TYPE_DICT) ahead of the first MSG that
+// uses it on each connection.
+//
+// Each codec is compiled in when CMake finds its library (PUBSUB_HAVE_LZ4,
+// PUBSUB_HAVE_ZSTD). codec_supported() says which ones are; a peer only
+// offers or accepts those, so a build without either never sees a
+// compressed frame.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef PUBSUB_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef PUBSUB_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#include "protocol.h"
+
+#define CODEC_MASK       (FLAG_LZ4 | FLAG_ZSTD)
+#define CODEC_HEAD       4          // original length in front of the codec output
+#define ZSTD_LEVEL       3
+
+inline bool codec_supported([[maybe_unused]] int codec) {
+#ifdef PUBSUB_HAVE_LZ4
+    if (codec == FLAG_LZ4) return true;
+#endif
+#ifdef PUBSUB_HAVE_ZSTD
+    if (codec == FLAG_ZSTD) return true;
+#endif
+    return false;
+}
+
+// The codecs built in, as flags.
+inline int built_codecs() {
+    return (codec_supported(FLAG_LZ4) ? FLAG_LZ4 : 0) | (codec_supported(FLAG_ZSTD) ? FLAG_ZSTD : 0);
+}
+
+// "lz4" / "zstd" to its flag; 0 for anything else.
+inline int codec_from_name(std::string_view s) {
+    return s == "lz4" ? FLAG_LZ4 : s == "zstd" ? FLAG_ZSTD : 0;
+}
+
+inline const char* codec_name(int codec) {
+    return codec == FLAG_LZ4 ? "lz4" : codec == FLAG_ZSTD ? "zstd" : "none";
+}
+
+#ifdef PUBSUB_HAVE_ZSTD
+// One compression and one decompression context per thread, reused.
+struct ZstdContexts {
+    ZSTD_CCtx* c = ZSTD_createCCtx();
+    ZSTD_DCtx* d = ZSTD_createDCtx();
+    ~ZstdContexts() { ZSTD_freeCCtx(c); ZSTD_freeDCtx(d); }
+
+    static ZstdContexts& local() {
+        thread_local ZstdContexts z;
+        return z;
+    }
+};
+#endif
+
+// A trained zstd dictionary, digested for the side that uses it: a sender
+// compresses with it, a receiver decompresses.
+class ZstdDictionary {
+public:
+    enum Use { Compress, Decompress };
+
+    ZstdDictionary(std::string bytes, [[maybe_unused]] Use use) : bytes_(std::move(bytes)) {
+#ifdef PUBSUB_HAVE_ZSTD
+        id_ = ZSTD_getDictID_fromDict(bytes_.data(), bytes_.size());
+        if (!id_) return;
+        if (use == Compress) cdict_ = ZSTD_createCDict(bytes_.data(), bytes_.size(), ZSTD_LEVEL);
+        else ddict_ = ZSTD_createDDict(bytes_.data(), bytes_.size());
+        if (!cdict_ && !ddict_) id_ = 0;
+#endif
+    }
+
+    ~ZstdDictionary() {
+#ifdef PUBSUB_HAVE_ZSTD
+        ZSTD_freeCDict(cdict_);
+        ZSTD_freeDDict(ddict_);
+#endif
+    }
+
+    ZstdDictionary(const ZstdDictionary&) = delete;
+    ZstdDictionary& operator=(const ZstdDictionary&) = delete;
+
+    // 0 if the bytes are not a zstd dictionary (or zstd is not built in).
+    uint32_t id() const { return id_; }
+    const std::string& bytes() const { return bytes_; }
+
+#ifdef PUBSUB_HAVE_ZSTD
+    const ZSTD_CDict* cdict() const { return cdict_; }
+    const ZSTD_DDict* ddict() const { return ddict_; }
+#endif
+
+private:
+    std::string bytes_;
+    uint32_t id_ = 0;
+#ifdef PUBSUB_HAVE_ZSTD
+    ZSTD_CDict* cdict_ = nullptr;
+    ZSTD_DDict* ddict_ = nullptr;
+#endif
+};
+
+// Most bytes compress_payload() writes for `n` input bytes; 0 if `codec`
+// is not built in.
+inline size_t compress_bound([[maybe_unused]] int codec, [[maybe_unused]] size_t n) {
+#ifdef PUBSUB_HAVE_LZ4
+    if (codec == FLAG_LZ4) return CODEC_HEAD + (size_t)LZ4_compressBound((int)n);
+#endif
+#ifdef PUBSUB_HAVE_ZSTD
+    if (codec == FLAG_ZSTD) return CODEC_HEAD + ZSTD_compressBound(n);
+#endif
+    return 0;
+}
+
+// Compresses `in` into out[0, cap), cap >= compress_bound(). `dict` (zstd
+// only) may be null. Returns the payload's size, or -1.
+inline long compress_payload([[maybe_unused]] int codec, [[maybe_unused]] const ZstdDictionary* dict,
+                             std::string_view in, char* out, size_t cap) {
+    if (in.size() > MAX_PAYLOAD_LEN || cap < CODEC_HEAD) return -1;
+    put_u32(out, (uint32_t)in.size());
+    [[maybe_unused]] char* dst = out + CODEC_HEAD;
+    cap -= CODEC_HEAD;
+#ifdef PUBSUB_HAVE_LZ4
+    if (codec == FLAG_LZ4) {
+        int n = LZ4_compress_default(in.data(), dst, (int)in.size(), (int)cap);
+        return n > 0 ? CODEC_HEAD + n : -1;
+    }
+#endif
+#ifdef PUBSUB_HAVE_ZSTD
+    if (codec == FLAG_ZSTD) {
+        ZSTD_CCtx* c = ZstdContexts::local().c;
+        size_t n = dict ? ZSTD_compress_usingCDict(c, dst, cap, in.data(), in.size(), dict->cdict())
+                        : ZSTD_compressCCtx(c, dst, cap, in.data(), in.size(), ZSTD_LEVEL);
+        return ZSTD_isError(n) ? -1 : (long)(CODEC_HEAD + n);
+    }
+#endif
+    return -1;
+}
+
+// Id of the dictionary a FLAG_ZSTD payload was compressed with; 0 for none.
+inline uint32_t payload_dict_id([[maybe_unused]] std::string_view in) {
+#ifdef PUBSUB_HAVE_ZSTD
+    if (in.size() > CODEC_HEAD) return ZSTD_getDictID_fromFrame(in.data() + CODEC_HEAD, in.size() - CODEC_HEAD);
+#endif
+    return 0;
+}
+
+// Replaces `out` with the decompressed payload. `dict` must be the one
+// payload_dict_id() names. false if the payload does not decode to the size
+// it claims.
+inline bool decompress_payload([[maybe_unused]] int codec, [[maybe_unused]] const ZstdDictionary* dict,
+                               std::string_view in, std::string& out) {
+    if (in.size() < CODEC_HEAD) return false;
+    uint32_t len = get_u32(in.data());
+    if (len > MAX_PAYLOAD_LEN) return false;
+    out.resize(len);
+    [[maybe_unused]] const char* src = in.data() + CODEC_HEAD;
+    [[maybe_unused]] size_t n = in.size() - CODEC_HEAD;
+#ifdef PUBSUB_HAVE_LZ4
+    if (codec == FLAG_LZ4)
+        return LZ4_decompress_safe(src, &out[0], (int)n, (int)len) == (int)len;
+#endif
+#ifdef PUBSUB_HAVE_ZSTD
+    if (codec == FLAG_ZSTD) {
+        ZSTD_DCtx* d = ZstdContexts::local().d;
+        size_t r = dict ? ZSTD_decompress_usingDDict(d, &out[0], len, src, n, dict->ddict())
+                        : ZSTD_decompressDCtx(d, &out[0], len, src, n);
+        return !ZSTD_isError(r) && r == len;
+    }
+#endif
+    return false;
+}
+
+// Trains a dictionary of at most `max` bytes on the concatenated `samples`;
+// empty if zstd is not built in or the samples are too few or too alike.
+inline std::string train_dictionary([[maybe_unused]] const std::string& samples,
+                                    [[maybe_unused]] const std::vector<size_t>& sizes, [[maybe_unused]] size_t max) {
+    std::string dict;
+#ifdef PUBSUB_HAVE_ZSTD
+    dict.resize(max);
+    size_t n = ZDICT_trainFromBuffer(&dict[0], max, samples.data(), sizes.data(), (unsigned)sizes.size());
+    dict.resize(ZDICT_isError(n) ? 0 : n);
+#endif
+    return dict;
+}
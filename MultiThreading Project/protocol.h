@@ -0,0 +1,152 @@
+// protocol.h — Wire format shared by client and server
+// Every frame is Header || [extension] || topic || payload. The three header
+// fields are 32-bit integers in network byte order; topic and payload are raw
+// bytes. The extension is present only when a flag in the type word asks for it.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Message Types
+#define TYPE_SUBSCRIBE   1
+#define TYPE_PUBLISH     2
+#define TYPE_MSG         3
+#define TYPE_ACK         4
+#define TYPE_TERM        5
+#define TYPE_UNSUBSCRIBE 6
+#define TYPE_PING        7      // keep-alive from a client; refreshes its idle timer, no reply
+#define TYPE_NACK        8      // FLAG_SEQ; payload: 64-bit count. Subscriber: resend the
+                                // topic's MSGs [seq, seq+count), count 0 = all from seq on.
+                                // Server: those MSGs are gone and will not be resent.
+#define TYPE_DICT        9      // Server: payload is the zstd dictionary that later
+                                // FLAG_ZSTD MSGs of the topic may name by id.
+#define TYPE_LOCATE      10     // Client: which node owns the topic? The ACK's payload
+                                // names it (IPv4 address, port; 6 bytes, network
+                                // order), or is empty if any node will do.
+
+// The header's first word is type | flags. Flags live above TYPE_MASK and
+// are only sent to a peer that asked for them, so legacy peers never see one.
+#define TYPE_MASK        0xff
+#define FLAG_RAW         0x100  // PUBLISH/MSG: payload is raw bytes, not Base64.
+                                // SUBSCRIBE: send this connection raw MSGs;
+                                // the server echoes it in the ACK.
+#define FLAG_SEQ         0x200  // A 64-bit sequence number follows the header.
+                                // PUBLISH/ACK: the ACK repeats the publish's.
+                                // SUBSCRIBE: send MSGs with their topic seq; the
+                                // ACK carries the topic's newest seq so far.
+#define FLAG_NOACK       0x400  // PUBLISH: fire-and-forget, the server sends no ACK.
+#define FLAG_CUMACK      0x800  // PUBLISH with FLAG_SEQ: the sender accepts
+                                // cumulative ACKs; one ACK for seq s confirms
+                                // every publish up to s on that connection.
+#define FLAG_REPLAY      0x1000 // SUBSCRIBE: first replay the topic's retained
+                                // messages; with FLAG_SEQ those from its seq on
+                                // (0 = all), else only the newest one.
+#define FLAG_MCAST       0x2000 // SUBSCRIBE (UDP): the client can join multicast
+                                // groups. ACK: the topic goes to the group in the
+                                // payload (IPv4 address, port; 6 bytes, network
+                                // order), raw and with FLAG_SEQ; join it to receive.
+#define FLAG_LZ4         0x4000 // MSG: the raw payload is compressed (payload_codec.h).
+#define FLAG_ZSTD        0x8000 // SUBSCRIBE with FLAG_RAW: the connection accepts
+                                // that codec; the ACK echoes those the server
+                                // will use on it.
+#define FLAG_FORWARD     0x10000 // PUBLISH/SUBSCRIBE from a cluster peer: handle it on
+                                // this node only, never pass it on to another.
+
+// Limits enforced by the receiver; a frame beyond them is a protocol error.
+// A UDP frame must also fit one datagram (UDP_MAX_FRAME), so larger
+// payloads need TCP.
+#define MAX_TOPIC_LEN    255
+#define MAX_PAYLOAD_LEN  (16u << 20)
+#define UDP_MAX_FRAME    65507
+
+struct Header { int type, topic_len, payload_len; };
+static_assert(sizeof(Header) == 12, "Header must be three packed 32-bit fields");
+
+inline uint32_t get_u32(const char* p) {
+    const unsigned char* u = (const unsigned char*)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+
+inline void put_u32(char* p, uint32_t v) {
+    p[0] = (char)(v >> 24);
+    p[1] = (char)(v >> 16);
+    p[2] = (char)(v >> 8);
+    p[3] = (char)v;
+}
+
+inline uint64_t get_u64(const char* p) {
+    return ((uint64_t)get_u32(p) << 32) | get_u32(p + 4);
+}
+
+inline void put_u64(char* p, uint64_t v) {
+    put_u32(p, (uint32_t)(v >> 32));
+    put_u32(p + 4, (uint32_t)v);
+}
+
+// Header plus the extension that the flags in `type` call for.
+inline size_t head_size(int type) {
+    return sizeof(Header) + ((type & FLAG_SEQ) ? 8 : 0);
+}
+
+inline size_t frame_size(size_t topic_len, size_t payload_len, int type = 0) {
+    return head_size(type) + topic_len + payload_len;
+}
+
+inline void write_header(char* out, int type, size_t topic_len, size_t payload_len) {
+    put_u32(out, (uint32_t)type);
+    put_u32(out + 4, (uint32_t)topic_len);
+    put_u32(out + 8, (uint32_t)payload_len);
+}
+
+// Header and extension; returns where the topic goes.
+inline char* write_head(char* out, int type, size_t topic_len, size_t payload_len, uint64_t seq = 0) {
+    write_header(out, type, topic_len, payload_len);
+    if (type & FLAG_SEQ) put_u64(out + sizeof(Header), seq);
+    return out + head_size(type);
+}
+
+// Appends one encoded frame to `out`.
+inline void encode_frame(std::vector<char>& out, int type, std::string_view topic, std::string_view payload,
+                         uint64_t seq = 0) {
+    size_t at = out.size();
+    out.resize(at + frame_size(topic.size(), payload.size(), type));
+    char* p = write_head(out.data() + at, type, topic.size(), payload.size(), seq);
+    if (!topic.empty()) memcpy(p, topic.data(), topic.size());
+    if (!payload.empty()) memcpy(p + topic.size(), payload.data(), payload.size());
+}
+
+// A decoded frame; topic and payload point into the caller's buffer.
+struct FrameView {
+    int type;                   // low bits of the first word
+    int flags;                  // the FLAG_* bits above them
+    uint64_t seq;               // FLAG_SEQ only
+    std::string_view topic;
+    std::string_view payload;
+};
+
+// Total size of the frame starting at `data`, from its header alone; 0 if
+// fewer than a header's bytes are there yet.
+inline size_t peek_frame_size(const char* data, size_t n) {
+    if (n < sizeof(Header)) return 0;
+    return frame_size(get_u32(data + 4), get_u32(data + 8), (int)get_u32(data));
+}
+
+// Parses the frame at the start of [data, data+n).
+// Returns the frame's size, 0 if more bytes are needed, -1 if malformed.
+inline long parse_frame(const char* data, size_t n, FrameView& f) {
+    if (n < sizeof(Header)) return 0;
+    uint32_t word = get_u32(data), tlen = get_u32(data + 4), plen = get_u32(data + 8);
+    if (tlen > MAX_TOPIC_LEN || plen > MAX_PAYLOAD_LEN) return -1;
+    size_t head = head_size((int)word), need = head + tlen + plen;
+    if (n < need) return 0;
+    f.type = (int)(word & TYPE_MASK);
+    f.flags = (int)(word & ~(uint32_t)TYPE_MASK);
+    f.seq = (word & FLAG_SEQ) ? get_u64(data + sizeof(Header)) : 0;
+    f.topic = std::string_view(data + head, tlen);
+    f.payload = std::string_view(data + head + tlen, plen);
+    return (long)need;
+}
@@ -0,0 +1,310 @@
+// reactor.h — Readiness-based event loop for the server (epoll on Linux, WSAPoll on Windows)
+// Each EventLoop runs on one thread and owns the sockets registered with its Poller.
+// Other threads never touch those sockets; they hand work to the owning loop with post().
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "net.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+// Best effort: false where thread affinity is not supported.
+inline bool pin_current_thread(int cpu) {
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Anything registered with a Poller. Hangups and socket errors are reported as
+// readable so the handler discovers them through its next recv().
+struct IoHandler {
+    virtual ~IoHandler() = default;
+    virtual void on_ready(bool readable, bool writable) = 0;
+};
+
+// ----- Poller backends -----
+#ifdef _WIN32
+
+// Loopback UDP socket connected to itself; one byte wakes WSAPoll.
+class Waker {
+public:
+    Waker() {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int len = sizeof(a);
+        bind(fd_, (sockaddr*)&a, sizeof(a));
+        getsockname(fd_, (sockaddr*)&a, &len);
+        connect(fd_, (sockaddr*)&a, sizeof(a));
+        set_nonblocking(fd_);
+    }
+    ~Waker() { close_socket(fd_); }
+    sock_t fd() const { return fd_; }
+    void wake() { char b = 1; send(fd_, &b, 1, 0); }
+    void drain() { char b[64]; while (recv(fd_, b, sizeof(b), 0) > 0) {} }
+private:
+    sock_t fd_;
+};
+
+class Poller {
+public:
+    bool add(sock_t s, IoHandler* h, bool want_write, bool want_read = true) {
+        WSAPOLLFD p{};
+        p.fd = s;
+        p.events = (want_read ? POLLRDNORM : 0) | (want_write ? POLLWRNORM : 0);
+        index_[s] = fds_.size();
+        fds_.push_back(p);
+        tags_.push_back(h);
+        return true;
+    }
+    bool update(sock_t s, IoHandler*, bool want_write, bool want_read = true) {
+        auto it = index_.find(s);
+        if (it == index_.end()) return false;
+        fds_[it->second].events = (want_read ? POLLRDNORM : 0) | (want_write ? POLLWRNORM : 0);
+        return true;
+    }
+    void remove(sock_t s) {
+        auto it = index_.find(s);
+        if (it == index_.end()) return;
+        size_t i = it->second, last = fds_.size() - 1;
+        if (i != last) {
+            fds_[i] = fds_[last];
+            tags_[i] = tags_[last];
+            index_[fds_[i].fd] = i;
+        }
+        fds_.pop_back();
+        tags_.pop_back();
+        index_.erase(it);
+    }
+    // Calls fn(handler, readable, writable) per ready socket; handler is nullptr for the waker.
+    template <class Fn>
+    void wait(int timeout_ms, Fn&& fn) {
+        if (fds_.empty()) { Sleep(timeout_ms); return; }
+        int n = WSAPoll(fds_.data(), (ULONG)fds_.size(), timeout_ms);
+        if (n <= 0) return;
+        // Handlers may add/remove sockets while we dispatch, so snapshot the ready set first.
+        ready_.clear();
+        for (size_t i = 0; i < fds_.size(); ++i) {
+            short re = fds_[i].revents;
+            if (!re) continue;
+            ready_.push_back({tags_[i], (re & (POLLRDNORM | POLLHUP | POLLERR)) != 0,
+                              (re & POLLWRNORM) != 0});
+        }
+        for (auto& r : ready_) fn(r.h, r.readable, r.writable);
+    }
+private:
+    struct Ready { IoHandler* h; bool readable, writable; };
+    std::vector<WSAPOLLFD> fds_;
+    std::vector<IoHandler*> tags_;
+    std::unordered_map<sock_t, size_t> index_;
+    std::vector<Ready> ready_;
+};
+
+#else
+
+class Waker {
+public:
+    Waker() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~Waker() { if (fd_ >= 0) ::close(fd_); }
+    sock_t fd() const { return fd_; }
+    void wake() { uint64_t one = 1; (void)!::write(fd_, &one, sizeof(one)); }
+    void drain() { uint64_t v; (void)!::read(fd_, &v, sizeof(v)); }
+private:
+    int fd_;
+};
+
+// Level-triggered epoll; EPOLLOUT is only armed while a connection has unsent
+// bytes, and EPOLLIN is dropped for one that has stopped reading.
+class Poller {
+public:
+    Poller() : ep_(epoll_create1(EPOLL_CLOEXEC)) {}
+    ~Poller() { if (ep_ >= 0) ::close(ep_); }
+    bool add(sock_t s, IoHandler* h, bool want_write, bool want_read = true) {
+        return ctl(EPOLL_CTL_ADD, s, h, want_write, want_read);
+    }
+    bool update(sock_t s, IoHandler* h, bool want_write, bool want_read = true) {
+        return ctl(EPOLL_CTL_MOD, s, h, want_write, want_read);
+    }
+    void remove(sock_t s) { epoll_ctl(ep_, EPOLL_CTL_DEL, s, nullptr); }
+    // Calls fn(handler, readable, writable) per ready socket; handler is nullptr for the waker.
+    template <class Fn>
+    void wait(int timeout_ms, Fn&& fn) {
+        epoll_event evs[256];
+        int n = epoll_wait(ep_, evs, 256, timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            uint32_t e = evs[i].events;
+            fn((IoHandler*)evs[i].data.ptr, (e & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0,
+               (e & EPOLLOUT) != 0);
+        }
+    }
+private:
+    bool ctl(int op, sock_t s, IoHandler* h, bool want_write, bool want_read) {
+        epoll_event ev{};
+        ev.events = (want_read ? (uint32_t)EPOLLIN : 0u) | (want_write ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.ptr = h;
+        return epoll_ctl(ep_, op, s, &ev) == 0;
+    }
+    int ep_;
+};
+
+#endif
+
+// ----- Event loop -----
+class EventLoop {
+public:
+    using Task = std::function<void()>;
+
+    EventLoop() { poller_.add(waker_.fd(), nullptr, false); }
+
+    Poller& poller() { return poller_; }
+
+    bool in_loop_thread() const { return owner_.load(std::memory_order_relaxed) == std::this_thread::get_id(); }
+
+    // Thread-safe. Tasks posted from the loop's own thread skip the wakeup syscall.
+    void post(Task t) {
+        if (in_loop_thread()) { local_.push_back(std::move(t)); return; }
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            tasks_.push_back(std::move(t));
+            if (!wake_pending_) { wake_pending_ = true; wake = true; }
+        }
+        if (wake) waker_.wake();
+    }
+
+    // Keeps an object alive until the current dispatch round has finished, so a
+    // handler can drop its own last reference from inside on_ready().
+    void release_later(std::shared_ptr<void> p) { graveyard_.push_back(std::move(p)); }
+
+    // Periodic task on this loop. Call before start() or from the loop thread.
+    void run_every(int interval_ms, Task t) {
+        auto iv = std::chrono::milliseconds(interval_ms);
+        timers_.push_back({iv, std::chrono::steady_clock::now() + iv, std::move(t)});
+    }
+
+    // One-shot task on this loop, due `delay` from now. Loop thread only.
+    // Fires no earlier than due, rounded up to the poller's millisecond tick.
+    void run_after(std::chrono::microseconds delay, Task t) {
+        oneshots_.push_back({std::chrono::steady_clock::now() + delay, std::move(t)});
+        std::push_heap(oneshots_.begin(), oneshots_.end(), OneShot::later);
+    }
+
+    // Pins the loop's thread to `cpu` when it starts. Call before start().
+    void pin_to_cpu(int cpu) { cpu_ = cpu; }
+
+    void start() {
+        thread_ = std::thread([this] {
+            if (cpu_ >= 0) pin_current_thread(cpu_);
+            run();
+        });
+    }
+    void join() { if (thread_.joinable()) thread_.join(); }
+    void stop() { stop_ = true; waker_.wake(); }
+
+    void run() {
+        owner_ = std::this_thread::get_id();
+        while (!stop_) {
+            poller_.wait(local_.empty() ? next_timeout_ms() : 0, [this](IoHandler* h, bool r, bool w) {
+                if (h) h->on_ready(r, w);
+                else waker_.drain();
+            });
+            run_tasks();
+            run_timers();
+            graveyard_.clear();
+        }
+    }
+
+private:
+    struct Timer {
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next;
+        Task task;
+    };
+
+    // Min-heap entry, earliest due first.
+    struct OneShot {
+        std::chrono::steady_clock::time_point due;
+        Task task;
+        static bool later(const OneShot& a, const OneShot& b) { return a.due > b.due; }
+    };
+
+    int next_timeout_ms() const {
+        int ms = 1000;
+        auto now = std::chrono::steady_clock::now();
+        auto until = [&](std::chrono::steady_clock::time_point at) {
+            auto d = std::chrono::ceil<std::chrono::milliseconds>(at - now).count();
+            if (d < ms) ms = d < 0 ? 0 : (int)d;
+        };
+        for (auto& t : timers_) until(t.next);
+        if (!oneshots_.empty()) until(oneshots_.front().due);
+        return ms;
+    }
+
+    void run_timers() {
+        if (timers_.empty() && oneshots_.empty()) return;
+        auto now = std::chrono::steady_clock::now();
+        for (auto& t : timers_) {
+            if (now < t.next) continue;
+            t.next = now + t.interval;
+            t.task();
+        }
+        // A task may schedule another; pop before running it.
+        while (!oneshots_.empty() && oneshots_.front().due <= now) {
+            std::pop_heap(oneshots_.begin(), oneshots_.end(), OneShot::later);
+            Task t = std::move(oneshots_.back().task);
+            oneshots_.pop_back();
+            t();
+        }
+    }
+
+    void run_tasks() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            running_.swap(tasks_);
+            wake_pending_ = false;
+        }
+        for (auto& t : running_) t();
+        running_.clear();
+        // Local tasks may post more local tasks; those run on the next iteration.
+        std::vector<Task> local;
+        local.swap(local_);
+        for (auto& t : local) t();
+    }
+
+    Poller poller_;
+    Waker waker_;
+    std::atomic<std::thread::id> owner_{};
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+    int cpu_ = -1;
+    std::mutex mtx_;
+    std::vector<Task> tasks_, running_;
+    bool wake_pending_ = false;
+    std::vector<Task> local_;
+    std::vector<Timer> timers_;
+    std::vector<OneShot> oneshots_;
+    std::vector<std::shared_ptr<void>> graveyard_;
+};
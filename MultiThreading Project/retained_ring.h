@@ -0,0 +1,92 @@
+// retained_ring.h — Per-topic history of recent MSG frames for late joiners
+// Keeps the newest frames of one topic, bounded by count, total bytes and
+// age, whichever bites first. Frames are the shared FrameRefs built for the
+// live fan-out (MSG | FLAG_SEQ, in the publisher's encoding), so retaining a
+// message costs a reference, not a copy.
+//
+// `mtx` is the topic's sequencer: publishers hold it while they number the
+// message, append it and fan it out, and a replaying subscriber holds it
+// while it joins the topic and drains the history. Every message therefore
+// reaches a late joiner exactly once and in order, replayed or live. It also
+// means the retained seqs are consecutive, so a range is found by offset.
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "shared_frame.h"
+
+class RetainedRing {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        uint64_t seq;
+        Clock::time_point at;
+        FrameRef frame;
+    };
+
+    // max_bytes or max_age 0 lifts that limit; max_msgs must not be 0. The
+    // newest message is kept even when it alone exceeds max_bytes.
+    RetainedRing(size_t max_msgs, size_t max_bytes, std::chrono::seconds max_age)
+        : max_msgs_(max_msgs), max_bytes_(max_bytes), max_age_(max_age) {}
+
+    std::mutex mtx;
+
+    // Caller holds mtx.
+    void push(uint64_t seq, const FrameRef& frame, Clock::time_point now) {
+        entries_.push_back({seq, now, frame});
+        bytes_ += frame.size();
+        while (entries_.size() > max_msgs_ || (max_bytes_ && bytes_ > max_bytes_ && entries_.size() > 1))
+            pop_front();
+        expire(now);
+    }
+
+    // Caller holds mtx. Calls fn(const Entry&) for each retained message with
+    // seq >= from, oldest first; with last_only, just for the newest one.
+    template <class Fn>
+    size_t replay(uint64_t from, bool last_only, Clock::time_point now, Fn&& fn) {
+        expire(now);
+        if (entries_.empty()) return 0;
+        if (last_only) {
+            fn(entries_.back());
+            return 1;
+        }
+        size_t n = 0;
+        for (const Entry& e : entries_)
+            if (e.seq >= from) { fn(e); ++n; }
+        return n;
+    }
+
+    // Caller holds mtx. Calls fn(const Entry&) for at most `max` retained
+    // messages with from <= seq < to, oldest first. Returns the oldest
+    // retained seq, or 0 when nothing is retained.
+    template <class Fn>
+    uint64_t range(uint64_t from, uint64_t to, size_t max, Clock::time_point now, Fn&& fn) {
+        expire(now);
+        if (entries_.empty()) return 0;
+        uint64_t first = entries_.front().seq;
+        size_t i = from > first ? (size_t)(from - first) : 0;
+        for (; i < entries_.size() && max && entries_[i].seq < to; ++i, --max) fn(entries_[i]);
+        return first;
+    }
+
+private:
+    void pop_front() {
+        bytes_ -= entries_.front().frame.size();
+        entries_.pop_front();
+    }
+
+    void expire(Clock::time_point now) {
+        if (max_age_.count() == 0) return;
+        while (!entries_.empty() && now - entries_.front().at > max_age_) pop_front();
+    }
+
+    size_t max_msgs_, max_bytes_;
+    std::chrono::seconds max_age_;
+    std::deque<Entry> entries_;
+    size_t bytes_ = 0;
+};
@@ -1,122 +1,1621 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <winsock2.h>
-#include <ws2tcpip.h>
 #include <thread>
 #include <vector>
 #include <mutex>
-#pragma comment(lib, "ws2_32.lib")
+#include <memory>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "base64.h"
+#include "net.h"
+#include "protocol.h"
+#include "reactor.h"
+#include "retained_ring.h"
+#include "shared_frame.h"
+#include "slab_pool.h"
+#include "slot_table.h"
+#include "topic_codec.h"
+#include "epoch.h"
+#include "hash_ring.h"
+#include "outbound_queue.h"
+#include "server_metrics.h"
+#include "topic_registry.h"
+#include "udp_io.h"
 using namespace std;
 
-#define TOPIC_LEN 64
-#define MSG_LEN   1024
 #define MAX_CLIENTS 50
+#define DEFAULT_BACKLOG 4096
+#define READ_CHUNK 16384
+#define LARGE_READ_MAX (1 << 20)  // most one recv takes of a large frame
+#define DEFAULT_ZEROCOPY_MIN (64 << 10)
+#define ZEROCOPY_LINGER_S 10      // zerocopy frames outlive a closed socket this long
+#define DEFAULT_QUEUE_LIMIT 1024
+#define WRITE_BATCH 64            // frames per gather-send
+#define STATS_INTERVAL_MS 10000
+#define DEFAULT_ACK_EVERY 32      // cumulative ACK after this many publishes...
+#define DEFAULT_ACK_DELAY_US 1000 // ...or this long after the first unacknowledged one
+#define METRICS_MAX_REQUEST 8192  // bytes of HTTP request head the metrics endpoint reads
+#define IDLE_SWEEP_MS 1000        // how often each loop looks for idle clients
+#define DEFAULT_RETAIN_BYTES (1 << 20)  // per topic, when --retain is on
+#define UDP_NACK_BURST 64          // most messages resent for one NACK
+#define LINK_RETRY_MS 500          // a failed cluster link reconnects after this long
+#define LINK_PING_MS 1000          // keeps a link inside the peer's --idle-timeout
+#define LINK_BUFFER_MAX (8 << 20)  // forwarded bytes held for a peer that is away
 
-// Message Types
-#define TYPE_SUBSCRIBE  10
-#define TYPE_PUBLISH    11
-#define TYPE_MSG        12
-#define TYPE_ACK        2
-#define TYPE_TERM       3
-
-struct Message {
-    int type;
-    char topic[TOPIC_LEN];
-    int payload_len;
-    char content[MSG_LEN];
+// Subscriber::kind
+#define SUB_TCP 0
+#define SUB_UDP 1
+
+// Outbound queue settings, fixed at startup.
+size_t queue_limit = DEFAULT_QUEUE_LIMIT;
+OverflowPolicy overflow_policy = OverflowPolicy::DropOldest;
+
+// Cumulative ACK settings, fixed at startup.
+uint64_t ack_every = DEFAULT_ACK_EVERY;
+long ack_delay_us = DEFAULT_ACK_DELAY_US;
+
+// Frames at least this big go to a TCP subscriber with MSG_ZEROCOPY where
+// the platform has it; 0 turns it off. Fixed at startup.
+size_t zerocopy_min = DEFAULT_ZEROCOPY_MIN;
+
+// Clients silent for this long (any frame counts, TYPE_PING included) are
+// dropped; 0 keeps them until they leave. Fixed at startup.
+long idle_timeout_s = 0;
+
+// Retained history per topic, for replay on SUBSCRIBE and for resending
+// what a UDP subscriber NACKs; both counts 0 turn it off. Fixed at startup.
+size_t retain_msgs = 0;
+size_t udp_window = 0;         // at least this many, for NACKs
+
+// --multicast TOPIC=GROUP:PORT, fixed at startup: UDP subscribers of TOPIC
+// that can join groups receive it through one datagram per publish.
+unordered_map<string, sockaddr_in> mcast_groups;
+
+bool parse_mcast_mapping(const string& s) {
+    size_t eq = s.find('='), colon = s.rfind(':');
+    if (eq == string::npos || eq == 0 || colon == string::npos || colon < eq) return false;
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    if (inet_pton(AF_INET, s.substr(eq + 1, colon - eq - 1).c_str(), &a.sin_addr) != 1) return false;
+    if ((ntohl(a.sin_addr.s_addr) >> 28) != 14) return false;     // 224.0.0.0/4
+    int port = atoi(s.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) return false;
+    a.sin_port = htons((uint16_t)port);
+    mcast_groups[s.substr(0, eq)] = a;
+    return true;
+}
+size_t retain_bytes = DEFAULT_RETAIN_BYTES;
+long retain_seconds = 0;
+
+// --compress TOPIC=lz4|zstd, fixed at startup: subscribers of TOPIC that
+// accept the codec get its MSGs compressed. LZ4 suits latency-sensitive
+// topics; zstd, with a dictionary trained per topic, bulk ones.
+unordered_map<string, int> compress_topics;
+
+// Returns the mapping's codec, 0 if it does not parse.
+int parse_compress_mapping(const string& s) {
+    size_t eq = s.find('=');
+    if (eq == string::npos || eq == 0 || TopicTrie::is_pattern(s.substr(0, eq))) return 0;
+    int codec = codec_from_name(string_view(s).substr(eq + 1));
+    if (codec) compress_topics[s.substr(0, eq)] = codec;
+    return codec;
+}
+
+// --node ID=HOST:PORT for every member (this one included) and --node-id ID,
+// fixed at startup. Topics are sharded over the members by consistent
+// hashing: a topic's owner numbers, retains and delivers it, and the other
+// nodes pass its publishes and their subscribers' interest on to the owner
+// over persistent links (PeerLink). Patterns span every node.
+struct ClusterNode {
+    string id;
+    sockaddr_in addr;
 };
+vector<ClusterNode> cluster_nodes;     // sorted by id, the ring's node numbers
+int cluster_self = -1;                 // this node's index; -1 when not clustered
+HashRing cluster_ring;
+
+bool parse_node(const string& s) {
+    size_t eq = s.find('='), colon = s.rfind(':');
+    if (eq == string::npos || eq == 0 || colon == string::npos || colon < eq) return false;
+    ClusterNode n;
+    n.id = s.substr(0, eq);
+    n.addr = sockaddr_in{};
+    n.addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, s.substr(eq + 1, colon - eq - 1).c_str(), &n.addr.sin_addr) != 1) return false;
+    int port = atoi(s.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) return false;
+    n.addr.sin_port = htons((uint16_t)port);
+    cluster_nodes.push_back(n);
+    return true;
+}
+
+bool owns_topic(string_view topic) {
+    return cluster_self < 0 || cluster_ring.owner(topic) == (uint32_t)cluster_self;
+}
+
+// Per-message logging: every Nth publish per thread, 0 for none.
+uint64_t log_sample = 0;
+
+MetricsRegistry metrics;
+
+struct Conn : IoHandler, Subscriber, enable_shared_from_this<Conn> {
+    Conn() { kind = SUB_TCP; }
+
+    sock_t sock;
+    EventLoop* loop;
+    shared_ptr<Conn> self;      // keeps the connection alive while registered
 
-struct ClientInfo {
-    SOCKET sock;
-    string topic;
-    bool subscribed = false;
+    // owner loop only
+    vector<char, SlabAllocator<char>> in;   // received bytes; frames are parsed in place
+    size_t in_off = 0;          // start of the first unparsed frame
+    vector<FrameRef> sending;   // frames popped from `out`, being written
+    size_t send_idx = 0;        // first frame in `sending` not fully written
+    size_t send_off = 0;        // bytes of sending[send_idx] already written
+    SlotId slot;                // in the owner loop's loop_conns
+    chrono::steady_clock::time_point last_rx;   // last time the peer sent anything
+    bool registered = false;
+    bool want_write = false;
+    bool open = true;
+    bool terminating = false;   // TERM received: close once `out` is drained
+    uint64_t ack_seq = 0;       // highest contiguous FLAG_CUMACK seq received
+    uint64_t ack_pending = 0;   // publishes up to ack_seq not yet acknowledged
+    bool ack_armed = false;     // a cumulative ACK timer is scheduled
+    bool zerocopy = false;      // SO_ZEROCOPY is on
+    bool peer = false;          // a cluster node, known by its FLAG_FORWARD SUBSCRIBEs; set before it joins a topic
+    uint32_t zc_next = 0;       // number of the next zerocopy send
+    deque<pair<uint32_t, FrameRef>> zc_pending;     // frames the kernel may still read, by send number
+
+    // any thread
+    mutex out_mtx;
+    OutboundQueue<FrameRef> out{queue_limit};
+    vector<uint32_t> dicts_sent;    // ids of the zstd dictionaries queued so far
+    bool flush_pending = false;
+    bool closed = false;        // also set when the queue overflowed under Disconnect
+
+    void on_ready(bool readable, bool writable) override;
 };
 
-vector<ClientInfo> clients;
-mutex clients_mtx;
+// The connections this loop thread owns, for the idle sweep.
+thread_local SlotTable<Conn> loop_conns;
+
+// Publishers walk topic snapshots under an epoch guard without taking
+// registry_mtx; that lock only serializes subscribe/unsubscribe. A closed
+// Conn is retired through `epoch` as well, after the snapshots that still
+// mention it, so a publisher never sees a freed Conn.
+EpochDomain epoch;
+TopicRegistry registry(epoch);
+mutex registry_mtx;
+
+// Topics whose master list this loop thread changed during the current
+// dispatch round. They are re-published once, in a task that runs before any
+// ACK queued in the same round is flushed, so a burst of N subscribes to one
+// topic costs one snapshot copy rather than N.
+thread_local unordered_set<TopicId> dirty_topics;
+
+void cluster_topic_changed(TopicRegistry::Topic* t);
+
+void publish_dirty_topics() {
+    lock_guard<mutex> lock(registry_mtx);
+    for (TopicId id : dirty_topics) {
+        registry.publish(id);
+        cluster_topic_changed(registry.topic(id));
+    }
+    dirty_topics.clear();
+}
+
+// Caller holds registry_mtx and runs on `loop`.
+void mark_dirty(EventLoop* loop, TopicId id) {
+    if (dirty_topics.empty()) loop->post(publish_dirty_topics);
+    dirty_topics.insert(id);
+}
+
+// Caller holds registry_mtx. Gives a new topic its retained history (on its
+// owner) and its codec; both are in place before any thread can reach it.
+TopicRegistry::Topic* intern_topic(string_view name) {
+    TopicRegistry::Topic* t = registry.intern(name);
+    size_t keep = max(retain_msgs, udp_window);
+    if (keep && !t->pattern && !t->retained && owns_topic(t->name))
+        t->retained.reset(new RetainedRing(keep, retain_bytes, chrono::seconds(retain_seconds)));
+    if (!compress_topics.empty() && !t->codec) {
+        auto c = compress_topics.find(t->name);
+        if (c != compress_topics.end()) t->codec.reset(new TopicCodec(c->second));
+    }
+    return t;
+}
+
+// Lock-free after the first lookup of a name on this thread; topics live as
+// long as the registry, so cached pointers (and keys viewing Topic::name)
+// never dangle.
+TopicRegistry::Topic* lookup_topic(string_view name) {
+    thread_local unordered_map<string_view, TopicRegistry::Topic*> cache;
+    auto it = cache.find(name);
+    if (it != cache.end()) return it->second;
+    lock_guard<mutex> lock(registry_mtx);
+    TopicRegistry::Topic* t = intern_topic(name);
+    cache.emplace(t->name, t);
+    return t;
+}
+
+// A UDP client, identified by its address. Owned by UdpServer's loop.
+struct UdpPeer : Subscriber {
+    UdpPeer() { kind = SUB_UDP; }
+    sockaddr_in addr;
+    chrono::steady_clock::time_point last_rx;   // UDP loop only
+};
+
+// The UDP socket is shared: any publisher thread may sendmmsg fan-out
+// datagrams on it, only its owning loop receives.
+sock_t udp_sock = INVALID_SOCK;
+
+void conn_flush(Conn& c);
+void conn_close(Conn& c);
 
-void handle_client(SOCKET clientSock) {
-    Message msg;
+// Sends iov[0], the rest of c.sending[c.send_idx], from the frame's own
+// pages and keeps the frame until the kernel is done with them. Copies as
+// usual when the kernel is out of zerocopy resources (ENOBUFS).
+long send_zerocopy(Conn& c, IoVec* iov) {
+#ifdef NET_HAVE_ZEROCOPY
+    long w = send_iov(c.sock, iov, 1, MSG_ZEROCOPY);
+    if (w < 0 && errno == ENOBUFS) return send_iov(c.sock, iov, 1);
+    if (w >= 0) {
+        c.zc_pending.push_back({c.zc_next++, c.sending[c.send_idx]});
+        metrics.local().zerocopy_sends.add();
+    }
+    return w;
+#else
+    return send_iov(c.sock, iov, 1);
+#endif
+}
+
+// Owner loop: drops the frames whose zerocopy sends have completed.
+void reap_zerocopy_sends(Conn& c) {
+#ifdef NET_HAVE_ZEROCOPY
+    ThreadMetrics& m = metrics.local();
+    reap_zerocopy(c.sock, [&](uint32_t lo, uint32_t hi, bool copied) {
+        if (copied) m.zerocopy_copied.add(hi - lo + 1);
+        auto done = [&](const pair<uint32_t, FrameRef>& e) { return e.first - lo <= hi - lo; };
+        c.zc_pending.erase(remove_if(c.zc_pending.begin(), c.zc_pending.end(), done), c.zc_pending.end());
+    });
+#else
+    (void)c;
+#endif
+}
+
+// Thread-safe: queue one frame for `c` and make sure its loop will flush it.
+// Never blocks on the socket; a full queue is resolved by overflow_policy.
+// Control frames (ACKs) bypass the limit. The frame is shared, not copied.
+// A frame compressed against `dict` goes behind that dictionary's TYPE_DICT
+// frame, queued as a control frame the first time `c` needs it.
+void conn_send(Conn& c, const FrameRef& frame, bool control = false,
+               const TopicCodec::Dictionary* dict = nullptr) {
+    typedef OutboundQueue<FrameRef> Q;
+    Q::PushResult r;
+    size_t depth;
+    bool post_flush = false;
+    {
+        lock_guard<mutex> lock(c.out_mtx);
+        if (c.closed) return;
+        if (dict && find(c.dicts_sent.begin(), c.dicts_sent.end(), dict->zstd.id()) == c.dicts_sent.end()) {
+            c.dicts_sent.push_back(dict->zstd.id());
+            c.out.push(dict->frame, overflow_policy, true);
+        }
+        r = c.out.push(frame, overflow_policy, control);
+        depth = c.out.size();
+        if (r == Q::Overflow) {
+            c.closed = true;
+            c.out.clear();
+        }
+        else if (r != Q::DroppedNewest && !c.flush_pending) {
+            c.flush_pending = true;
+            post_flush = true;
+        }
+    }
+    ThreadMetrics& m = metrics.local();
+    if (!control) m.queue_depth.record(depth);
+    if (r == Q::DroppedOldest) m.dropped_oldest.add();
+    else if (r == Q::DroppedNewest) m.dropped_newest.add();
+    else if (r == Q::Overflow) {
+        m.slow_disconnects.add();
+        c.loop->post([p = c.shared_from_this()] { conn_close(*p); });
+    }
+    if (post_flush) c.loop->post([p = c.shared_from_this()] { conn_flush(*p); });
+}
+
+void conn_close(Conn& c) {
+    if (!c.open) return;
+    c.open = false;
+    metrics.local().tcp_closed.add();
+    {
+        lock_guard<mutex> lock(c.out_mtx);
+        c.closed = true;
+        c.out.clear();
+    }
+    {
+        lock_guard<mutex> lock(registry_mtx);
+        registry.unsubscribe_all(&c, [&](TopicId id) { mark_dirty(c.loop, id); });
+    }
+    if (c.registered) c.loop->poller().remove(c.sock);
+    loop_conns.remove(c.slot);
+    close_socket(c.sock);
+    // The kernel may still be sending from these, with no one left to say when.
+    if (!c.zc_pending.empty()) {
+        c.loop->run_after(chrono::seconds(ZEROCOPY_LINGER_S), [f = move(c.zc_pending)] {});
+        c.zc_pending.clear();
+    }
+    // Queued after publish_dirty_topics, so the snapshots dropping this Conn
+    // are retired before the Conn itself.
+    c.loop->post([p = move(c.self)]() mutable {
+        epoch.retire(new shared_ptr<Conn>(move(p)));
+    });
+}
+
+// Owner loop: write as much as the socket takes, arm writability for the rest.
+// Each round gathers up to WRITE_BATCH queued frames into one send; a frame
+// of zerocopy_min bytes or more goes in a send of its own, without a copy.
+void conn_flush(Conn& c) {
+    if (!c.open) return;
+    ThreadMetrics& m = metrics.local();
+    PhaseTimer timer(m.flush_ns);
+    IoVec iov[WRITE_BATCH];
     while (true) {
-        int n = recv(clientSock, (char*)&msg, sizeof(msg), 0);
-        if (n <= 0) {
+        if (c.send_idx == c.sending.size()) {
+            c.sending.clear();
+            c.send_idx = c.send_off = 0;
+            bool drained;
+            {
+                lock_guard<mutex> lock(c.out_mtx);
+                FrameRef f;
+                while (c.sending.size() < WRITE_BATCH && c.out.pop(f))
+                    c.sending.push_back(move(f));
+                drained = c.sending.empty();
+                if (drained) c.flush_pending = false;
+            }
+            if (drained) {
+                if (!c.terminating) break;
+                conn_close(c);      // takes out_mtx itself
+                return;
+            }
+        }
+        int n = 0;
+        bool zc = false;
+        for (size_t i = c.send_idx; i < c.sending.size(); ++i) {
+            size_t skip = (i == c.send_idx) ? c.send_off : 0;
+            size_t len = c.sending[i].size() - skip;
+            bool big = c.zerocopy && len >= zerocopy_min;
+            if (big && n) break;
+            iovec_set(iov[n++], c.sending[i].data() + skip, len);
+            if ((zc = big)) break;
+        }
+        long w = zc ? send_zerocopy(c, iov) : send_iov(c.sock, iov, n);
+        if (w < 0) {
+            if (last_error_interrupted()) continue;
+            if (last_error_would_block()) break;
+            conn_close(c);
+            return;
+        }
+        m.bytes_out.add((uint64_t)w);
+        // Retire fully written frames; the rest of a partial one stays.
+        size_t left = (size_t)w;
+        while (left && c.send_idx < c.sending.size()) {
+            size_t rem = c.sending[c.send_idx].size() - c.send_off;
+            if (left < rem) {
+                c.send_off += left;
+                break;
+            }
+            left -= rem;
+            c.sending[c.send_idx++] = FrameRef();
+            c.send_off = 0;
+        }
+    }
+    bool need = c.send_idx < c.sending.size();
+    if (need != c.want_write) {
+        c.want_write = need;
+        if (c.registered) c.loop->poller().update(c.sock, &c, need, !c.terminating);
+    }
+}
+
+void send_ack(Conn& conn, string_view topic, int flags = 0, uint64_t seq = 0) {
+    conn_send(conn, FrameRef::encode(TYPE_ACK | flags, topic, "", seq), true);
+}
+
+// Owner loop. Confirms everything up to ack_seq with one topic-less ACK.
+void flush_cum_ack(Conn& conn) {
+    if (!conn.open || conn.ack_pending == 0) return;
+    send_ack(conn, "", FLAG_SEQ, conn.ack_seq);
+    conn.ack_pending = 0;
+}
+
+// Owner loop. A FLAG_CUMACK publish is acknowledged with the highest
+// contiguous seq once ack_every of them are pending or ack_delay_us after the
+// first, whichever comes first. A seq that does not follow on (a gap, or one
+// already covered) is still delivered but confirms nothing: the run's pending
+// ACK goes out at once and ack_seq stays where the run ended, so an ACK never
+// covers a publish that did not arrive.
+void cum_ack(Conn& conn, uint64_t seq) {
+    if (seq != conn.ack_seq + 1) {
+        flush_cum_ack(conn);
+        return;
+    }
+    conn.ack_seq = seq;
+    if (++conn.ack_pending >= ack_every) {
+        flush_cum_ack(conn);
+        return;
+    }
+    if (conn.ack_armed) return;
+    conn.ack_armed = true;
+    conn.loop->run_after(chrono::microseconds(ack_delay_us), [p = conn.shared_from_this()] {
+        p->ack_armed = false;
+        flush_cum_ack(*p);
+    });
+}
+
+// Caller runs on `loop`, the loop that owns `s`.
+void subscribe(Subscriber* s, EventLoop* loop, string_view topic) {
+    lock_guard<mutex> lock(registry_mtx);
+    TopicId id = intern_topic(topic)->id;
+    if (registry.subscribe(s, id)) mark_dirty(loop, id);
+}
+
+void unsubscribe(Subscriber* s, EventLoop* loop, string_view topic) {
+    lock_guard<mutex> lock(registry_mtx);
+    TopicRegistry::Topic* t = registry.find(topic);
+    if (t && registry.unsubscribe(s, t->id)) mark_dirty(loop, t->id);
+}
+
+// MSG frame carrying base64(raw), encoded straight into the frame.
+// `flags` may add FLAG_SEQ, with `seq` in the extension.
+FrameRef encode_msg_b64(string_view topic, string_view raw, int flags = 0, uint64_t seq = 0) {
+    int type = TYPE_MSG | flags;
+    size_t elen = b64_encoded_len(raw.size());
+    FrameRef f = FrameRef::alloc(frame_size(topic.size(), elen, type));
+    char* p = write_head(f.data(), type, topic.size(), elen, seq);
+    memcpy(p, topic.data(), topic.size());
+    b64_encode_into(raw, p + topic.size(), elen);
+    return f;
+}
+
+// Raw MSG frame from a Base64 payload; empty if the payload is not Base64.
+FrameRef decode_msg_raw(string_view topic, string_view b64, int flags = 0, uint64_t seq = 0) {
+    int type = TYPE_MSG | FLAG_RAW | flags;
+    size_t max = b64_decoded_max(b64.size());
+    FrameRef f = FrameRef::alloc(frame_size(topic.size(), max, type));
+    long n = b64_decode_into(b64, f.data() + head_size(type) + topic.size(), max);
+    if (n < 0) return FrameRef();
+    char* p = write_head(f.data(), type, topic.size(), (size_t)n, seq);
+    memcpy(p, topic.data(), topic.size());
+    f.shrink(frame_size(topic.size(), (size_t)n, type));
+    return f;
+}
+
+// Compressed MSG frame (see payload_codec.h) from raw bytes; empty if the
+// codec fails or the result would be no smaller than the raw payload.
+FrameRef compress_msg(int codec, const ZstdDictionary* dict, string_view topic, string_view raw,
+                      int flags = 0, uint64_t seq = 0) {
+    int type = TYPE_MSG | FLAG_RAW | codec | flags;
+    size_t max = compress_bound(codec, raw.size());
+    FrameRef f = FrameRef::alloc(frame_size(topic.size(), max, type));
+    long n = compress_payload(codec, dict, raw, f.data() + head_size(type) + topic.size(), max);
+    if (n < 0 || (size_t)n >= raw.size()) return FrameRef();
+    char* p = write_head(f.data(), type, topic.size(), (size_t)n, seq);
+    memcpy(p, topic.data(), topic.size());
+    f.shrink(frame_size(topic.size(), (size_t)n, type));
+    ThreadMetrics& m = metrics.local();
+    m.compressed.add();
+    m.compress_saved.add(raw.size() - (size_t)n);
+    return f;
+}
+
+// One message in each form a subscriber can ask for: raw or Base64, with or
+// without its topic seq, and compressed with the topic's codec. Each form is
+// built at most once, on first use, and then shared by every subscriber that
+// wants it.
+struct MsgVariants {
+    string_view topic, payload;
+    bool raw;                   // payload is raw bytes (else Base64)
+    uint64_t seq;
+    TopicCodec* codec;          // the topic's; null if it is sent uncompressed
+    const TopicCodec::Dictionary* dict = nullptr;   // the one the compressed forms use
+    bool relayed = false;       // came from the topic's owner over a PeerLink
+    bool sampled = false;
+    FrameRef built[8];
+    bool tried[8] = {};
+
+    MsgVariants(string_view topic, string_view payload, bool raw, uint64_t seq, TopicCodec* codec)
+        : topic(topic), payload(payload), raw(raw), seq(seq), codec(codec) {}
+
+    // `caps` holds the subscriber's FLAG_RAW and FLAG_SEQ bits and the codecs
+    // it accepts (only ever with FLAG_RAW).
+    const FrameRef& get(int caps) {
+        bool packed = codec && (caps & codec->codec);
+        int k = ((caps & FLAG_RAW) ? 1 : 0) | ((caps & FLAG_SEQ) ? 2 : 0) | (packed ? 4 : 0);
+        if (!tried[k]) {
+            tried[k] = true;
+            int seq_flag = (k & 2) ? FLAG_SEQ : 0;
+            if (k & 4) built[k] = compress(seq_flag);
+            else if ((k & 1) == (raw ? 1 : 0))
+                built[k] = FrameRef::encode(TYPE_MSG | (raw ? FLAG_RAW : 0) | seq_flag, topic, payload, seq);
+            else if (raw) built[k] = encode_msg_b64(topic, payload, seq_flag, seq);
+            else built[k] = decode_msg_raw(topic, payload, seq_flag, seq);
+        }
+        // A message that does not shrink goes out uncompressed, and a legacy
+        // publish that is not valid Base64 is relayed as it came.
+        if (!built[k]) return get(packed ? caps & ~CODEC_MASK : caps & ~FLAG_RAW);
+        return built[k];
+    }
+
+    // The dictionary `frame` (from get()) needs on the receiving side, if any.
+    const TopicCodec::Dictionary* dict_for(const FrameRef& frame) const {
+        return dict && (get_u32(frame.data()) & FLAG_ZSTD) ? dict : nullptr;
+    }
+
+private:
+    FrameRef compress(int seq_flag) {
+        string_view plain = payload;
+        if (!raw) {
+            get(FLAG_RAW);      // decoded once, and shared with raw subscribers
+            if (!built[1]) return FrameRef();
+            size_t head = head_size(TYPE_MSG | FLAG_RAW) + topic.size();
+            plain = string_view(built[1].data() + head, built[1].size() - head);
+        }
+        if (!sampled) {
+            sampled = true;
+            codec->sample(topic, plain);
+            dict = codec->dict();
+        }
+        return compress_msg(codec->codec, dict ? &dict->zstd : nullptr, topic, plain, seq_flag, seq);
+    }
+};
+
+bool is_peer(const Subscriber* s) {
+    return s->kind == SUB_TCP && static_cast<const Conn*>(s)->peer;
+}
+
+// Hands one message to every current subscriber of `t` and of the wildcard
+// patterns matching it, once each, in the form the subscriber negotiated.
+// TCP queues hold references to the shared frames and UDP peers get them as
+// datagram bodies, sent in sendmmsg batches. A relayed message skips the
+// cluster peers: its owner has sent it to each one that wants it already.
+void deliver(TopicRegistry::Topic* t, MsgVariants& msg) {
+    EpochDomain::Guard g(epoch);
+    const SubscriberList* subs = registry.cached_route(t);
+    if (!subs) {
+        lock_guard<mutex> lock(registry_mtx);
+        subs = registry.route(t);
+    }
+    ThreadMetrics& m = metrics.local();
+    m.fanout.record(subs->subs.size());
+    m.deliveries.add(subs->subs.size());
+    UdpSender udp(udp_sock);
+    for (Subscriber* s : subs->subs) {
+        if (msg.relayed && is_peer(s)) continue;
+        const FrameRef& frame = msg.get(s->caps.load(memory_order_relaxed));
+        if (s->kind == SUB_TCP) conn_send(*static_cast<Conn*>(s), frame, false, msg.dict_for(frame));
+        else {
+            udp.add(static_cast<UdpPeer*>(s)->addr, frame.data(), frame.size());
+            m.bytes_out.add(frame.size());
+        }
+    }
+    udp.flush();
+    if (udp.dropped()) m.udp_dropped.add(udp.dropped());
+}
+
+// Numbers one publish on `topic` and delivers it. A topic with retained
+// history is sequenced under its ring's lock, which also orders the
+// message against any replay in progress (see retained_ring.h).
+void fan_out(string_view topic, string_view payload, bool raw) {
+    TopicRegistry::Topic* t = lookup_topic(topic);
+    RetainedRing* ring = t->retained.get();
+    if (!ring) {
+        MsgVariants msg{topic, payload, raw, t->last_seq.fetch_add(1, memory_order_relaxed) + 1, t->codec.get()};
+        deliver(t, msg);
+        return;
+    }
+    lock_guard<mutex> seq_lock(ring->mtx);
+    MsgVariants msg{topic, payload, raw, t->last_seq.fetch_add(1, memory_order_relaxed) + 1, t->codec.get()};
+    ring->push(msg.seq, msg.get((raw ? FLAG_RAW : 0) | FLAG_SEQ), RetainedRing::Clock::now());
+    deliver(t, msg);
+}
+
+// Owner loop of `s`. Joins `f.topic`, taking the subscriber's FLAG_RAW and
+// FLAG_SEQ preferences and those of its codecs that are built in and among
+// `codecs`, the ones its transport can carry. ack(flags, last_seq) confirms
+// it: FLAG_RAW and the accepted codecs echoed; FLAG_SEQ, if asked for, with
+// the topic's newest seq so far. With FLAG_REPLAY the topic's retained
+// messages then go out through send(FrameRef, Dictionary*) before any live
+// one: from the extension's seq on with FLAG_SEQ, otherwise only the last
+// value. Patterns and topics without history join without a replay.
+template <class Ack, class Send>
+void subscribe_topic(Subscriber* s, EventLoop* loop, const FrameView& f, int codecs, Ack&& ack, Send&& send) {
+    int accept = (f.flags & FLAG_RAW) ? f.flags & codecs & built_codecs() : 0;
+    s->caps.fetch_or((f.flags & (FLAG_RAW | FLAG_SEQ)) | accept, memory_order_relaxed);
+    int ack_flags = (f.flags & (FLAG_RAW | FLAG_SEQ)) | accept;
+    TopicRegistry::Topic* t = lookup_topic(f.topic);
+    RetainedRing* ring = t->retained.get();
+    if (!(f.flags & FLAG_REPLAY) || !ring) {
+        subscribe(s, loop, f.topic);
+        ack(ack_flags, t->last_seq.load(memory_order_relaxed));
+        return;
+    }
+    // Join under the sequencer and publish the snapshot at once, skipping the
+    // dirty-topic batching: a publish either precedes the join and is in the
+    // ring, or follows it and reaches `s` live.
+    lock_guard<mutex> seq_lock(ring->mtx);
+    {
+        lock_guard<mutex> lock(registry_mtx);
+        if (registry.subscribe(s, t->id)) {
+            registry.publish(t->id);
+            cluster_topic_changed(t);
+        }
+    }
+    ack(ack_flags, t->last_seq.load(memory_order_relaxed));
+    int caps = s->caps.load(memory_order_relaxed);
+    bool from_seq = f.flags & FLAG_SEQ;
+    size_t n = ring->replay(from_seq ? f.seq : 0, !from_seq, RetainedRing::Clock::now(),
+                            [&](const RetainedRing::Entry& e) {
+        FrameView m{};
+        parse_frame(e.frame.data(), e.frame.size(), m);
+        MsgVariants msg{m.topic, m.payload, (m.flags & FLAG_RAW) != 0, e.seq, t->codec.get()};
+        const FrameRef& frame = msg.get(caps);
+        send(frame, msg.dict_for(frame));
+    });
+    metrics.local().replayed.add(n);
+}
+
+// ----- Cluster links -----
+// This node's connection to one peer, owned by one loop. Any thread queues
+// frames into `pending`, and the loop writes whatever has piled up in one
+// send, so a burst of forwarded publishes costs a syscall per batch, not per
+// frame. The link is persistent: when it fails it reconnects every
+// LINK_RETRY_MS and first re-subscribes to everything this node wants from
+// the peer; the publishes queued meanwhile (up to LINK_BUFFER_MAX bytes)
+// follow, while those in the batch that was being written are lost.
+// What the peer sends back is the MSGs of those subscriptions, which go to
+// this node's own subscribers (relay()).
+struct PeerLink : IoHandler {
+    string name;                // the peer's node id
+    sockaddr_in addr;
+    EventLoop* loop;
+
+    // loop only
+    sock_t sock = INVALID_SOCK;
+    bool want_write = false;
+    vector<char> in;
+    size_t in_off = 0;
+    vector<char> sending;
+    size_t send_off = 0;
+
+    // any thread
+    mutex mtx;
+    bool connected = false;     // written by the loop
+    vector<char> pending;
+    bool flush_posted = false;
+    unordered_set<string> wanted;   // topics and patterns subscribed at the peer
+
+    // Any thread. False if the peer has been away long enough to fill the buffer.
+    bool forward(const FrameView& f) {
+        ThreadMetrics& m = metrics.local();
+        if (!queue(TYPE_PUBLISH | FLAG_NOACK | FLAG_FORWARD | (f.flags & FLAG_RAW), f.topic, f.payload, true)) {
+            m.forward_dropped.add();
+            return false;
+        }
+        m.forwarded.add();
+        return true;
+    }
+
+    // Caller holds registry_mtx, which orders the SUBSCRIBEs and UNSUBSCRIBEs.
+    // While the link is down only `wanted` changes: on_connected() subscribes
+    // to all of it.
+    void want(const string& topic, bool on) {
+        bool post;
+        {
+            lock_guard<mutex> lock(mtx);
+            if (on ? !wanted.insert(topic).second : !wanted.erase(topic)) return;
+            if (!connected) return;
+            post = push(on ? TYPE_SUBSCRIBE | FLAG_RAW | FLAG_SEQ | FLAG_FORWARD : TYPE_UNSUBSCRIBE | FLAG_FORWARD,
+                        topic, "");
+        }
+        if (post) loop->post([this] { flush(); });
+    }
+
+    bool queue(int type, string_view topic, string_view payload, bool droppable) {
+        bool post;
+        {
+            lock_guard<mutex> lock(mtx);
+            if (droppable && pending.size() >= LINK_BUFFER_MAX) return false;
+            post = push(type, topic, payload);
+        }
+        if (post) loop->post([this] { flush(); });
+        return true;
+    }
+
+    // Loop only.
+    void connect_now() {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == INVALID_SOCK) { retry(); return; }
+        set_nonblocking(sock);
+        set_nodelay(sock);
+        if (connect(sock, (const sockaddr*)&addr, sizeof(addr)) != 0 && !last_error_in_progress()) {
+            close_socket(sock);
+            sock = INVALID_SOCK;
+            retry();
+            return;
+        }
+        want_write = true;          // writable once connected
+        loop->poller().add(sock, this, true);
+    }
+
+    void ping() {
+        if (sock != INVALID_SOCK && send_off == sending.size()) queue(TYPE_PING, "", "", false);
+    }
+
+    void on_ready(bool readable, bool writable) override {
+        if (sock == INVALID_SOCK) return;
+        bool up;
+        {
+            lock_guard<mutex> lock(mtx);
+            up = connected;
+        }
+        if (!up) {
+            if (pending_error(sock) != 0) { fail(); return; }
+            on_connected();
+            if (sock == INVALID_SOCK) return;
+        }
+        else if (writable) write();
+        if (readable && sock != INVALID_SOCK) read();
+    }
+
+private:
+    // Caller holds mtx. True when the caller is to post the flush.
+    bool push(int type, string_view topic, string_view payload) {
+        encode_frame(pending, type, topic, payload);
+        bool post = connected && !flush_posted;
+        flush_posted |= post;
+        return post;
+    }
+
+    void retry() {
+        loop->run_after(chrono::milliseconds(LINK_RETRY_MS), [this] { connect_now(); });
+    }
+
+    void on_connected() {
+        cout << "Cluster link to " << name << " up" << endl;
+        {
+            lock_guard<mutex> lock(mtx);
+            connected = true;
+            flush_posted = false;
+            sending.clear();
+            send_off = 0;
+            for (const string& w : wanted) encode_frame(sending, TYPE_SUBSCRIBE | FLAG_RAW | FLAG_SEQ | FLAG_FORWARD, w, "");
+            sending.insert(sending.end(), pending.begin(), pending.end());
+            pending.clear();
+        }
+        write();
+    }
+
+    void flush() {
+        {
+            lock_guard<mutex> lock(mtx);
+            flush_posted = false;
+            if (!connected) return;
+            if (send_off == sending.size()) {
+                sending.swap(pending);
+                send_off = 0;
+            }
+            else sending.insert(sending.end(), pending.begin(), pending.end());
+            pending.clear();
+        }
+        write();
+    }
+
+    void write() {
+        while (send_off < sending.size()) {
+            int n = send(sock, sending.data() + send_off, (int)(sending.size() - send_off), 0);
+            if (n < 0) {
+                if (last_error_interrupted()) continue;
+                if (last_error_would_block()) break;
+                fail();
+                return;
+            }
+            metrics.local().bytes_out.add((uint64_t)n);
+            send_off += (size_t)n;
+        }
+        if (send_off == sending.size()) {
+            sending.clear();
+            send_off = 0;
+        }
+        bool need = send_off < sending.size();
+        if (need != want_write) {
+            want_write = need;
+            loop->poller().update(sock, this, need);
+        }
+    }
+
+    void read() {
+        while (true) {
+            size_t have = in.size();
+            in.resize(have + READ_CHUNK);
+            int n = recv(sock, in.data() + have, READ_CHUNK, 0);
+            in.resize(have + (n > 0 ? n : 0));
+            if (n == 0 || (n < 0 && !last_error_would_block() && !last_error_interrupted())) {
+                fail();
+                return;
+            }
+            if (n < 0) {
+                if (last_error_interrupted()) continue;
+                return;
+            }
+            metrics.local().bytes_in.add((uint64_t)n);
+            FrameView f;
+            long used;
+            while ((used = parse_frame(in.data() + in_off, in.size() - in_off, f)) > 0) {
+                in_off += (size_t)used;
+                if (f.type == TYPE_MSG) relay(f);
+            }
+            if (used < 0) {
+                cerr << "Malformed frame from cluster node " << name << endl;
+                fail();
+                return;
+            }
+            if (in_off == in.size()) {
+                in.clear();
+                in_off = 0;
+            }
+            else if (in_off > READ_CHUNK) {
+                in.erase(in.begin(), in.begin() + in_off);
+                in_off = 0;
+            }
+            if (n < READ_CHUNK) return;
+        }
+    }
+
+    // A MSG of a topic this node proxies, numbered by its owner: delivered
+    // here, with the owner's seq, to this node's subscribers.
+    void relay(const FrameView& f) {
+        TopicRegistry::Topic* t = lookup_topic(f.topic);
+        if (f.seq > t->last_seq.load(memory_order_relaxed)) t->last_seq.store(f.seq, memory_order_relaxed);
+        MsgVariants msg{f.topic, f.payload, (f.flags & FLAG_RAW) != 0, f.seq, t->codec.get()};
+        msg.relayed = true;
+        deliver(t, msg);
+        metrics.local().relayed.add();
+    }
+
+    void fail() {
+        loop->poller().remove(sock);
+        close_socket(sock);
+        sock = INVALID_SOCK;
+        bool was;
+        {
+            lock_guard<mutex> lock(mtx);
+            was = connected;
+            connected = false;
+        }
+        if (was) cout << "Cluster link to " << name << " lost, reconnecting" << endl;
+        sending.clear();
+        send_off = 0;
+        in.clear();
+        in_off = 0;
+        want_write = false;
+        retry();
+    }
+};
+
+// By node index; null at this node's own.
+vector<unique_ptr<PeerLink>> cluster_links;
+
+// The link to the node that owns `topic`; null if that is this node.
+PeerLink* owner_link(string_view topic) {
+    return cluster_self < 0 ? nullptr : cluster_links[cluster_ring.owner(topic)].get();
+}
+
+// Caller holds registry_mtx. Keeps this node's subscriptions at its peers in
+// step with its own subscribers: a topic owned elsewhere is wanted from its
+// owner, and a pattern from every peer, while a client of this node (not a
+// peer) is on it.
+void cluster_topic_changed(TopicRegistry::Topic* t) {
+    if (cluster_self < 0 || (!t->pattern && owns_topic(t->name))) return;
+    bool local = any_of(t->subs.begin(), t->subs.end(),
+                        [](const TopicRegistry::Entry& e) { return !is_peer(e.sub); });
+    if (!t->pattern) owner_link(t->name)->want(t->name, local);
+    else for (auto& l : cluster_links) if (l) l->want(t->name, local);
+}
+
+// TYPE_LOCATE's answer: the owner's address (6 bytes), or nothing when any
+// node will do.
+string locate_topic(string_view topic) {
+    if (cluster_self < 0 || TopicTrie::is_pattern(topic)) return string();
+    const sockaddr_in& a = cluster_nodes[cluster_ring.owner(topic)].addr;
+    string where(6, '\0');
+    memcpy(&where[0], &a.sin_addr.s_addr, 4);
+    memcpy(&where[4], &a.sin_port, 2);
+    return where;
+}
+
+// A publish on a topic another node owns goes to that node, which numbers
+// and delivers it (this node's subscribers included). A FLAG_FORWARD one came
+// from a peer and is delivered here, whatever this node's ring says.
+void accept_publish(const FrameView& f) {
+    if (!(f.flags & FLAG_FORWARD))
+        if (PeerLink* l = owner_link(f.topic)) {
+            l->forward(f);
+            return;
+        }
+    fan_out(f.topic, f.payload, f.flags & FLAG_RAW);
+}
+
+// True for the publishes that --log-sample asks to be logged; counts per thread.
+bool sample_publish(MetricCounter& publishes) {
+    publishes.add();
+    return log_sample && publishes.get() % log_sample == 0;
+}
+
+void handle_message(Conn& conn, const FrameView& f) {
+    if (f.type == TYPE_SUBSCRIBE) {
+        if (f.flags & FLAG_FORWARD) conn.peer = true;
+        subscribe_topic(&conn, conn.loop, f, CODEC_MASK,
+                        [&](int flags, uint64_t seq) { send_ack(conn, f.topic, flags, seq); },
+                        [&](const FrameRef& m, const TopicCodec::Dictionary* dict) {
+                            conn_send(conn, m, false, dict);
+                        });
+        cout << (conn.peer ? "Cluster node" : "Client") << " subscribed to " << f.topic << endl;
+    }
+    else if (f.type == TYPE_PUBLISH) {
+        if (sample_publish(metrics.local().tcp_publishes)) {
+            if (f.flags & FLAG_RAW)
+                cout << "Publish on topic " << f.topic << " : " << f.payload.size() << " raw bytes" << endl;
+            else
+                cout << "Publish on topic " << f.topic << " : " << f.payload << endl;
+        }
+        accept_publish(f);
+        if (f.flags & FLAG_NOACK) return;
+        if ((f.flags & (FLAG_SEQ | FLAG_CUMACK)) == (FLAG_SEQ | FLAG_CUMACK)) cum_ack(conn, f.seq);
+        else send_ack(conn, f.topic, f.flags & FLAG_SEQ, f.seq);
+    }
+    else if (f.type == TYPE_UNSUBSCRIBE) {
+        unsubscribe(&conn, conn.loop, f.topic);
+        cout << "Client unsubscribed from " << f.topic << endl;
+        send_ack(conn, f.topic);
+    }
+    else if (f.type == TYPE_LOCATE) {
+        conn_send(conn, FrameRef::encode(TYPE_ACK, f.topic, locate_topic(f.topic)), true);
+    }
+    else if (f.type == TYPE_PING) {
+        // Keep-alive: getting here already refreshed last_rx.
+    }
+    else if (f.type == TYPE_TERM) {
+        cout << "Client terminated\n";
+        flush_cum_ack(conn);
+        send_ack(conn, f.topic);
+        conn.terminating = true;
+    }
+}
+
+void Conn::on_ready(bool readable, bool writable) {
+    if (!zc_pending.empty()) reap_zerocopy_sends(*this);   // completions also wake us as readable
+    if (writable) conn_flush(*this);
+    if (!readable || !open || terminating) return;
+
+    shared_ptr<Conn> keep = shared_from_this();
+    ThreadMetrics& m = metrics.local();
+    last_rx = chrono::steady_clock::now();
+    // Bounded number of reads per wakeup so one busy client cannot starve the loop.
+    for (int round = 0; round < 4 && open; ++round) {
+        // The rest of a large frame is read in one go, up to LARGE_READ_MAX.
+        size_t have = in.size(), part = have - in_off, want = READ_CHUNK;
+        size_t need = peek_frame_size(in.data() + in_off, part);
+        if (need > part) {
+            in.reserve(in_off + need);
+            want = max(want, min(need - part, (size_t)LARGE_READ_MAX));
+        }
+        in.resize(have + want);
+        int n;
+        {
+            PhaseTimer timer(m.recv_ns);
+            n = recv(sock, in.data() + have, (int)want, 0);
+        }
+        in.resize(have + (n > 0 ? n : 0));
+        if (n == 0 || (n < 0 && !last_error_would_block() && !last_error_interrupted())) {
             cout << "Client disconnected\n";
-            closesocket(clientSock);
+            conn_close(*this);
             return;
         }
+        if (n < 0) {
+            if (last_error_interrupted()) continue;
+            break;
+        }
+        m.bytes_in.add((uint64_t)n);
+        // Each frame is handled straight out of `in`; a trailing partial
+        // frame stays there until the rest of it arrives.
+        PhaseTimer timer(m.dispatch_ns);
+        while (open && !terminating) {
+            FrameView f;
+            long used = parse_frame(in.data() + in_off, in.size() - in_off, f);
+            if (used < 0) {
+                cerr << "Malformed frame, dropping client\n";
+                conn_close(*this);
+                return;
+            }
+            if (used == 0) break;
+            in_off += (size_t)used;
+            handle_message(*this, f);
+        }
+        if (!open) return;
+        if (terminating) {
+            // Nothing more is read: a peer that keeps sending, or has
+            // half-closed, would otherwise wake the level-triggered poller on
+            // every wait until the TERM ACK is out.
+            if (registered) loop->poller().update(sock, this, want_write, false);
+            return;
+        }
+        if (in_off == in.size()) {
+            in.clear();
+            in_off = 0;
+        }
+        else if (in_off > READ_CHUNK) {
+            in.erase(in.begin(), in.begin() + in_off);
+            in_off = 0;
+        }
+        if ((size_t)n < want) break;
+    }
+}
 
-        if (msg.type == TYPE_SUBSCRIBE) {
-            lock_guard<mutex> lock(clients_mtx);
-            for (auto &c : clients) {
-                if (c.sock == clientSock) {
-                    c.subscribed = true;
-                    c.topic = msg.topic;
-                }
+// Loop thread: closes this loop's connections that have been silent for
+// longer than idle_timeout_s.
+void sweep_idle_conns() {
+    auto cutoff = chrono::steady_clock::now() - chrono::seconds(idle_timeout_s);
+    loop_conns.for_each([&](Conn* c) {
+        if (c->last_rx >= cutoff) return;
+        cout << "Client idle for " << idle_timeout_s << " s, disconnecting\n";
+        metrics.local().idle_timeouts.add();
+        conn_close(*c);
+    });
+}
+
+// Accepts connections and spreads them round-robin over `loops`. With
+// SO_REUSEPORT sharding every loop has its own Listener whose only loop is
+// itself, so a new connection never leaves the accepting thread.
+struct Listener : IoHandler {
+    sock_t sock;
+    vector<EventLoop*> loops;
+    size_t next = 0;
+
+    void on_ready(bool readable, bool) override {
+        if (!readable) return;
+        while (true) {
+            sockaddr_in clientAddr{};
+            socklen_t len = sizeof(clientAddr);
+            sock_t clientSock = accept(sock, (sockaddr*)&clientAddr, &len);
+            if (clientSock == INVALID_SOCK) {
+                if (!last_error_would_block() && !last_error_interrupted())
+                    cerr << "accept failed\n";
+                return;
             }
-            cout << "Client subscribed to " << msg.topic << endl;
-            Message ack{};
-            ack.type = TYPE_ACK;
-            strncpy(ack.topic, msg.topic, TOPIC_LEN);
-            send(clientSock, (char*)&ack, sizeof(ack), 0);
-        }
-        else if (msg.type == TYPE_PUBLISH) {
-            cout << "Publish on topic " << msg.topic
-                 << " : " << msg.content << endl;
-            lock_guard<mutex> lock(clients_mtx);
-            for (auto &c : clients) {
-                if (c.subscribed && c.topic == msg.topic) {
-                    send(c.sock, (char*)&msg, sizeof(msg), 0);
+            set_nonblocking(clientSock);
+
+            metrics.local().tcp_opened.add();
+            auto c = allocate_shared<Conn>(SlabAllocator<Conn>());
+            c->sock = clientSock;
+            c->zerocopy = zerocopy_min && set_zerocopy(clientSock);
+            c->loop = loops[next++ % loops.size()];
+            c->self = c;
+            auto reg = [c] {
+                c->registered = true;
+                c->slot = loop_conns.insert(c.get());
+                c->last_rx = chrono::steady_clock::now();
+                c->loop->poller().add(c->sock, c.get(), false);
+            };
+            if (c->loop->in_loop_thread()) reg();
+            else c->loop->post(reg);
+        }
+    }
+};
+
+// UDP listener: one datagram is one frame. Clients are keyed by address and
+// subscribe, publish and TERM exactly as over TCP.
+struct UdpServer : IoHandler {
+    sock_t sock;
+    EventLoop* loop;
+    UdpReceiver rx;
+    unordered_map<uint64_t, unique_ptr<UdpPeer>> peers;
+    chrono::steady_clock::time_point now;   // taken once per wakeup
+
+    // A multicast-mapped topic is subscribed once, by a peer addressed to
+    // its group, however many members joined; those are only tallied here.
+    // Group peers live as long as the server.
+    struct McastTopic {
+        unique_ptr<UdpPeer> group;
+        unordered_set<UdpPeer*> members;
+    };
+    unordered_map<string, McastTopic> mcast;
+
+    static uint64_t key(const sockaddr_in& a) {
+        return ((uint64_t)a.sin_addr.s_addr << 16) | a.sin_port;
+    }
+
+    UdpPeer* peer(const sockaddr_in& from, bool create) {
+        auto it = peers.find(key(from));
+        if (it != peers.end()) return it->second.get();
+        if (!create) return nullptr;
+        UdpPeer* p = new UdpPeer;
+        p->addr = from;
+        p->last_rx = now;
+        peers.emplace(key(from), unique_ptr<UdpPeer>(p));
+        return p;
+    }
+
+    Subscriber* join_group(UdpPeer* p, string_view topic, const sockaddr_in& addr) {
+        McastTopic& m = mcast[string(topic)];
+        if (!m.group) {
+            m.group.reset(new UdpPeer);
+            m.group->addr = addr;
+            m.group->caps = FLAG_RAW | FLAG_SEQ;
+        }
+        m.members.insert(p);
+        return m.group.get();
+    }
+
+    void leave_group(UdpPeer* p, const string& topic) {
+        auto it = mcast.find(topic);
+        if (it == mcast.end() || !it->second.members.erase(p) || !it->second.members.empty()) return;
+        unsubscribe(it->second.group.get(), loop, topic);
+    }
+
+    void drop_peer(UdpPeer* p) {
+        for (auto& kv : mcast)
+            if (kv.second.members.count(p)) leave_group(p, kv.first);
+        {
+            lock_guard<mutex> lock(registry_mtx);
+            registry.unsubscribe_all(p, [&](TopicId id) { mark_dirty(loop, id); });
+        }
+        auto it = peers.find(key(p->addr));
+        UdpPeer* raw = it->second.release();
+        peers.erase(it);
+        // Same ordering as conn_close: retire after the snapshots that drop it.
+        loop->post([raw] { epoch.retire(raw); });
+    }
+
+    // Peers that went away without a TERM would otherwise stay subscribed
+    // (and keep receiving datagrams) forever.
+    void sweep_idle() {
+        auto cutoff = chrono::steady_clock::now() - chrono::seconds(idle_timeout_s);
+        vector<UdpPeer*> idle;
+        for (auto& kv : peers)
+            if (kv.second->last_rx < cutoff) idle.push_back(kv.second.get());
+        for (UdpPeer* p : idle) {
+            cout << "UDP client idle for " << idle_timeout_s << " s, dropping\n";
+            metrics.local().idle_timeouts.add();
+            drop_peer(p);
+        }
+    }
+
+    void ack(const sockaddr_in& to, string_view topic, int flags = 0, uint64_t seq = 0, string_view payload = {}) {
+        char buf[sizeof(Header) + 8 + MAX_TOPIC_LEN + 8];
+        char* p = write_head(buf, TYPE_ACK | flags, topic.size(), payload.size(), seq);
+        memcpy(p, topic.data(), topic.size());
+        memcpy(p + topic.size(), payload.data(), payload.size());
+        sendto(sock, buf, (int)frame_size(topic.size(), payload.size(), flags), 0, (const sockaddr*)&to, sizeof(to));
+    }
+
+    // Resends what `p` NACKed in `f` that the topic still retains, at most
+    // UDP_NACK_BURST messages per NACK so a long gap is pulled back at the
+    // subscriber's pace rather than flooding it; the subscriber NACKs the rest
+    // as the first part arrives. The part of the range that has left the
+    // ring is answered with a NACK, so the subscriber stops waiting for it.
+    void retransmit(UdpPeer* p, const FrameView& f) {
+        if (!(f.flags & FLAG_SEQ) || !f.seq || f.payload.size() != 8) return;
+        uint64_t count = get_u64(f.payload.data());
+        TopicRegistry::Topic* t = lookup_topic(f.topic);
+        RetainedRing* ring = t->retained.get();
+        unique_lock<mutex> seq_lock;
+        if (ring) seq_lock = unique_lock<mutex>(ring->mtx);
+        uint64_t last = t->last_seq.load(memory_order_relaxed);
+        if (f.seq > last) return;
+        uint64_t end = count && count <= last - f.seq ? f.seq + count : last + 1;
+        uint64_t gone = end;        // [f.seq, gone) is not retained
+        if (ring) {
+            // A multicast member subscribed through its group: resend in the group's form.
+            const Subscriber* form = p;
+            auto grp = mcast.find(string(f.topic));
+            if (grp != mcast.end() && grp->second.members.count(p)) form = grp->second.group.get();
+            int caps = form->caps.load(memory_order_relaxed) | FLAG_SEQ;
+            vector<FrameRef> frames;
+            UdpSender udp(sock);
+            uint64_t oldest = ring->range(f.seq, end, UDP_NACK_BURST, now, [&](const RetainedRing::Entry& e) {
+                FrameView m{};
+                parse_frame(e.frame.data(), e.frame.size(), m);
+                MsgVariants msg{m.topic, m.payload, (m.flags & FLAG_RAW) != 0, e.seq, t->codec.get()};
+                frames.push_back(msg.get(caps));
+                udp.add(p->addr, frames.back().data(), frames.back().size());
+            });
+            udp.flush();
+            metrics.local().retransmits.add(frames.size());
+            if (oldest) gone = min(max(oldest, f.seq), end);
+        }
+        if (gone > f.seq) {
+            char n[8];
+            put_u64(n, gone - f.seq);
+            FrameRef nack = FrameRef::encode(TYPE_NACK | FLAG_SEQ, f.topic, string_view(n, 8), f.seq);
+            sendto(sock, nack.data(), (int)nack.size(), 0, (const sockaddr*)&p->addr, sizeof(p->addr));
+        }
+    }
+
+    void on_ready(bool readable, bool) override {
+        if (!readable) return;
+        now = chrono::steady_clock::now();
+        // A few batches per wakeup, then let the loop serve its TCP sockets.
+        for (int round = 0; round < 4; ++round) {
+            const vector<Datagram>& got = rx.recv_batch(sock);
+            for (const Datagram& d : got) handle(d);
+            if (got.size() < UDP_BATCH) break;
+        }
+    }
+
+    void handle(const Datagram& d) {
+        metrics.local().bytes_in.add(d.len);
+        FrameView f;
+        long used = parse_frame(d.data, d.len, f);
+        if (used <= 0 || used != (long)d.len) return;
+        if (idle_timeout_s)
+            if (UdpPeer* p = peer(d.from, false)) p->last_rx = now;
+        if (f.type == TYPE_SUBSCRIBE) {
+            UdpPeer* p = peer(d.from, true);
+            string topic(f.topic);
+            auto g = (f.flags & FLAG_MCAST) ? mcast_groups.find(topic) : mcast_groups.end();
+            Subscriber* s = p;
+            char group[6];
+            if (g != mcast_groups.end()) {
+                s = join_group(p, f.topic, g->second);
+                unsubscribe(p, loop, f.topic);  // it had joined by unicast before
+                memcpy(group, &g->second.sin_addr.s_addr, 4);
+                memcpy(group + 4, &g->second.sin_port, 2);
+            }
+            else leave_group(p, topic);     // e.g. a member that could not join falls back to unicast
+            // A dictionary could be lost or overtaken on the way, so UDP
+            // subscribers get LZ4, which needs none, and not zstd. A group's
+            // form is fixed by join_group(), whatever its members accept: the
+            // ACK tells the member what the group sends.
+            subscribe_topic(s, loop, f, s == p ? FLAG_LZ4 : 0,
+                            [&](int flags, uint64_t seq) {
+                                if (s == p) ack(d.from, f.topic, flags, seq);
+                                else ack(d.from, f.topic, s->caps.load(memory_order_relaxed) | FLAG_MCAST, seq,
+                                         string_view(group, 6));
+                            },
+                            [&](const FrameRef& m, const TopicCodec::Dictionary*) {
+                                sendto(sock, m.data(), (int)m.size(), 0, (const sockaddr*)&d.from, sizeof(d.from));
+                            });
+            cout << "UDP client subscribed to " << f.topic << (s == p ? "" : " (multicast)") << endl;
+        }
+        else if (f.type == TYPE_PUBLISH) {
+            if (sample_publish(metrics.local().udp_publishes)) {
+                if (f.flags & FLAG_RAW)
+                    cout << "Publish on topic " << f.topic << " : " << f.payload.size() << " raw bytes (UDP)" << endl;
+                else
+                    cout << "Publish on topic " << f.topic << " : " << f.payload << " (UDP)" << endl;
+            }
+            accept_publish(f);
+            // Cumulative ACKs are TCP-only; a lost datagram would stall them.
+            if (!(f.flags & FLAG_NOACK)) ack(d.from, f.topic, f.flags & FLAG_SEQ, f.seq);
+        }
+        else if (f.type == TYPE_NACK) {
+            if (UdpPeer* p = peer(d.from, false)) retransmit(p, f);
+        }
+        else if (f.type == TYPE_LOCATE) {
+            ack(d.from, f.topic, 0, 0, locate_topic(f.topic));
+        }
+        else if (f.type == TYPE_UNSUBSCRIBE) {
+            if (UdpPeer* p = peer(d.from, false)) {
+                unsubscribe(p, loop, f.topic);
+                leave_group(p, string(f.topic));
+            }
+            ack(d.from, f.topic);
+        }
+        else if (f.type == TYPE_TERM) {
+            if (UdpPeer* p = peer(d.from, false)) drop_peer(p);
+            cout << "UDP client terminated\n";
+            ack(d.from, f.topic);
+        }
+    }
+};
+
+// One scrape of the metrics endpoint: reads the request head, answers
+// GET /metrics with the Prometheus text format (anything else with 404),
+// then closes. Runs on the endpoint's loop.
+struct MetricsClient : IoHandler {
+    sock_t sock;
+    EventLoop* loop;
+    shared_ptr<MetricsClient> self;
+    string request, response;
+    size_t sent = 0;
+    bool replying = false;
+
+    void on_ready(bool readable, bool writable) override {
+        if (readable && !replying) {
+            char buf[2048];
+            int n = recv(sock, buf, sizeof(buf), 0);
+            if (n == 0 || (n < 0 && !last_error_would_block() && !last_error_interrupted())) {
+                finish();
+                return;
+            }
+            if (n > 0) request.append(buf, (size_t)n);
+            if (request.find("\r\n\r\n") == string::npos && request.size() < METRICS_MAX_REQUEST) return;
+            reply();
+        }
+        if (replying && (writable || sent == 0)) write_some();
+    }
+
+    void reply() {
+        replying = true;
+        bool ok = request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0;
+        string body = ok ? metrics.render() : string("not found\n");
+        response = string(ok ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n") +
+                   (ok ? "Content-Type: text/plain; version=0.0.4\r\n" : "Content-Type: text/plain\r\n") +
+                   "Content-Length: " + to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    }
+
+    void write_some() {
+        while (sent < response.size()) {
+            IoVec v;
+            iovec_set(v, response.data() + sent, response.size() - sent);
+            long w = send_iov(sock, &v, 1);
+            if (w < 0) {
+                if (last_error_interrupted()) continue;
+                if (last_error_would_block()) {
+                    loop->poller().update(sock, this, true);
+                    return;
                 }
+                break;
             }
-            Message ack{};
-            ack.type = TYPE_ACK;
-            strncpy(ack.topic, msg.topic, TOPIC_LEN);
-            send(clientSock, (char*)&ack, sizeof(ack), 0);
+            sent += (size_t)w;
         }
-        else if (msg.type == TYPE_TERM) {
-            cout << "Client terminated\n";
-            closesocket(clientSock);
-            return;
+        finish();
+    }
+
+    void finish() {
+        loop->poller().remove(sock);
+        close_socket(sock);
+        loop->release_later(move(self));
+    }
+};
+
+struct MetricsListener : IoHandler {
+    sock_t sock;
+    EventLoop* loop;
+
+    void on_ready(bool readable, bool) override {
+        if (!readable) return;
+        while (true) {
+            sock_t s = accept(sock, nullptr, nullptr);
+            if (s == INVALID_SOCK) return;
+            set_nonblocking(s);
+            auto c = make_shared<MetricsClient>();
+            c->sock = s;
+            c->loop = loop;
+            c->self = c;
+            loop->poller().add(s, c.get(), false);
         }
     }
+};
+
+// Bound, listening, non-blocking TCP socket, or INVALID_SOCK.
+sock_t open_listener(const sockaddr_in& addr, int backlog, bool reuseport) {
+    sock_t s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == INVALID_SOCK) return s;
+    set_reuse_addr(s);
+    if ((reuseport && !set_reuse_port(s)) ||
+        bind(s, (const sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(s, backlog) != 0) {
+        close_socket(s);
+        return INVALID_SOCK;
+    }
+    set_nonblocking(s);
+    return s;
+}
+
+bool parse_on_off(const string& v, bool& out) {
+    if (v == "on") out = true;
+    else if (v == "off") out = false;
+    else return false;
+    return true;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " <port>\n";
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <port> [--loops N] [--backlog N] [--queue N]"
+             << " [--overflow drop-oldest|drop-newest|disconnect]"
+             << " [--reuseport on|off] [--pin on|off]"
+             << " [--ack-every N] [--ack-delay-us N]"
+             << " [--metrics-port N] [--log-sample N] [--idle-timeout S]"
+             << " [--retain N] [--retain-bytes B] [--retain-seconds S] [--udp-window N]"
+             << " [--multicast TOPIC=GROUP:PORT]... [--zerocopy-min B]"
+             << " [--compress TOPIC=lz4|zstd]... [--node ID=HOST:PORT]... [--node-id ID]\n";
         return 1;
     }
     int PORT = stoi(argv[1]);
+    unsigned cpus = thread::hardware_concurrency();
+    unsigned loops_n = cpus;
+    int backlog = DEFAULT_BACKLOG;
+    bool reuseport = true, pin = true;
+    int metrics_port = 0;
+    string node_id;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string opt = argv[i];
+        if (opt == "--loops") loops_n = (unsigned)stoi(argv[i + 1]);
+        else if (opt == "--backlog") backlog = stoi(argv[i + 1]);
+        else if (opt == "--reuseport" || opt == "--pin") {
+            if (!parse_on_off(argv[i + 1], opt == "--pin" ? pin : reuseport)) {
+                cerr << opt << " takes on or off\n";
+                return 1;
+            }
+        }
+        else if (opt == "--queue") queue_limit = (size_t)stoul(argv[i + 1]);
+        else if (opt == "--ack-every") ack_every = max<uint64_t>(1, stoull(argv[i + 1]));
+        else if (opt == "--ack-delay-us") ack_delay_us = max(0L, stol(argv[i + 1]));
+        else if (opt == "--metrics-port") metrics_port = stoi(argv[i + 1]);
+        else if (opt == "--log-sample") log_sample = stoull(argv[i + 1]);
+        else if (opt == "--idle-timeout") idle_timeout_s = max(0L, stol(argv[i + 1]));
+        else if (opt == "--retain") retain_msgs = (size_t)stoul(argv[i + 1]);
+        else if (opt == "--multicast") {
+            if (!parse_mcast_mapping(argv[i + 1])) {
+                cerr << "--multicast takes TOPIC=GROUP:PORT with a multicast GROUP\n";
+                return 1;
+            }
+        }
+        else if (opt == "--compress") {
+            int codec = parse_compress_mapping(argv[i + 1]);
+            if (!codec) {
+                cerr << "--compress takes TOPIC=lz4 or TOPIC=zstd, for a topic without wildcards\n";
+                return 1;
+            }
+            if (!codec_supported(codec)) {
+                cerr << "--compress: this server was built without " << codec_name(codec) << "\n";
+                return 1;
+            }
+        }
+        else if (opt == "--node") {
+            if (!parse_node(argv[i + 1])) {
+                cerr << "--node takes ID=HOST:PORT with an IPv4 HOST\n";
+                return 1;
+            }
+        }
+        else if (opt == "--node-id") node_id = argv[i + 1];
+        else if (opt == "--zerocopy-min") zerocopy_min = (size_t)stoul(argv[i + 1]);
+        else if (opt == "--udp-window") udp_window = (size_t)stoul(argv[i + 1]);
+        else if (opt == "--retain-bytes") retain_bytes = (size_t)stoul(argv[i + 1]);
+        else if (opt == "--retain-seconds") retain_seconds = max(0L, stol(argv[i + 1]));
+        else if (opt == "--overflow") {
+            if (!parse_overflow_policy(argv[i + 1], overflow_policy)) {
+                cerr << "Unknown overflow policy " << argv[i + 1] << "\n";
+                return 1;
+            }
+        }
+        else { cerr << "Unknown option " << opt << "\n"; return 1; }
+    }
+    if (loops_n == 0) loops_n = 1;
+    if (!cluster_nodes.empty() || !node_id.empty()) {
+        sort(cluster_nodes.begin(), cluster_nodes.end(),
+             [](const ClusterNode& a, const ClusterNode& b) { return a.id < b.id; });
+        for (size_t i = 0; i < cluster_nodes.size(); ++i) {
+            if (i && cluster_nodes[i].id == cluster_nodes[i - 1].id) {
+                cerr << "--node " << cluster_nodes[i].id << " given twice\n";
+                return 1;
+            }
+            if (cluster_nodes[i].id == node_id) cluster_self = (int)i;
+            cluster_ring.add((uint32_t)i, cluster_nodes[i].id);
+        }
+        if (cluster_self < 0) {
+            cerr << "--node-id must name one of the --node entries\n";
+            return 1;
+        }
+    }
+#ifndef NET_HAVE_REUSEPORT_LB
+    reuseport = false;
+#endif
 
-    WSADATA wsa;
-    WSAStartup(MAKEWORD(2,2), &wsa);
-
-    SOCKET serverSock = socket(AF_INET, SOCK_STREAM, 0);
+    if (!net_init()) {
+        cerr << "Socket layer initialization failed\n";
+        return 1;
+    }
 
     sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_port = htons(PORT);
     serverAddr.sin_addr.s_addr = INADDR_ANY;
 
-    bind(serverSock, (sockaddr*)&serverAddr, sizeof(serverAddr));
-    listen(serverSock, 5);
-
-    cout << "Server listening on port " << PORT << endl;
+    udp_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (bind(udp_sock, (sockaddr*)&serverAddr, sizeof(serverAddr)) != 0) {
+        cerr << "Cannot bind UDP port " << PORT << "\n";
+        return 1;
+    }
+    set_nonblocking(udp_sock);
 
-    while (true) {
-        sockaddr_in clientAddr{};
-        int len = sizeof(clientAddr);
-        SOCKET clientSock = accept(serverSock, (sockaddr*)&clientAddr, &len);
+    vector<unique_ptr<EventLoop>> loops;
+    for (unsigned i = 0; i < loops_n; ++i) {
+        loops.push_back(make_unique<EventLoop>());
+        if (pin && cpus) loops.back()->pin_to_cpu((int)(i % cpus));
+    }
 
-        {
-            lock_guard<mutex> lock(clients_mtx);
-            clients.push_back(ClientInfo{clientSock, "", false});
+    // Sharded: one SO_REUSEPORT listener per loop; the kernel balances new
+    // connections across them, so accepts scale with the loops and share no
+    // state. Otherwise one listener on loop 0 deals connections round-robin.
+    vector<unique_ptr<Listener>> listeners;
+    for (unsigned i = 0; i < (reuseport ? loops_n : 1); ++i) {
+        auto l = make_unique<Listener>();
+        l->sock = open_listener(serverAddr, backlog, reuseport);
+        if (l->sock == INVALID_SOCK) {
+            cerr << "Cannot listen on port " << PORT << "\n";
+            return 1;
         }
-
-        thread t(handle_client, clientSock);
-        t.detach();
+        if (reuseport) l->loops.push_back(loops[i].get());
+        else for (auto& lp : loops) l->loops.push_back(lp.get());
+        loops[i]->poller().add(l->sock, l.get(), false);
+        listeners.push_back(move(l));
+    }
+    UdpServer udp;
+    udp.sock = udp_sock;
+    udp.loop = loops.back().get();
+    udp.loop->poller().add(udp_sock, &udp, false);
+    MetricsListener metrics_listener;
+    if (metrics_port) {
+        sockaddr_in a = serverAddr;
+        a.sin_port = htons(metrics_port);
+        metrics_listener.sock = open_listener(a, backlog, false);
+        if (metrics_listener.sock == INVALID_SOCK) {
+            cerr << "Cannot listen on metrics port " << metrics_port << "\n";
+            return 1;
+        }
+        metrics_listener.loop = loops[0].get();
+        loops[0]->poller().add(metrics_listener.sock, &metrics_listener, false);
     }
+    if (idle_timeout_s) {
+        for (auto& l : loops) l->run_every(IDLE_SWEEP_MS, sweep_idle_conns);
+        udp.loop->run_every(IDLE_SWEEP_MS, [&udp] { udp.sweep_idle(); });
+    }
+    for (size_t i = 0; i < cluster_nodes.size(); ++i) {
+        if ((int)i == cluster_self) { cluster_links.emplace_back(); continue; }
+        auto link = make_unique<PeerLink>();
+        link->name = cluster_nodes[i].id;
+        link->addr = cluster_nodes[i].addr;
+        link->loop = loops[i % loops_n].get();
+        PeerLink* p = link.get();
+        link->loop->post([p] { p->connect_now(); });
+        link->loop->run_every(LINK_PING_MS, [p] { p->ping(); });
+        cluster_links.push_back(move(link));
+    }
+    // Quiet while idle: a line only when something moved.
+    loops[0]->run_every(STATS_INTERVAL_MS, [] {
+        static uint64_t last_pub = 0, last_drop = 0;
+        uint64_t pub = metrics.total(&ThreadMetrics::tcp_publishes) + metrics.total(&ThreadMetrics::udp_publishes);
+        uint64_t o = metrics.total(&ThreadMetrics::dropped_oldest), n = metrics.total(&ThreadMetrics::dropped_newest);
+        uint64_t d = metrics.total(&ThreadMetrics::slow_disconnects), u = metrics.total(&ThreadMetrics::udp_dropped);
+        if (pub != last_pub)
+            cout << "Publishes: " << pub << " (" << (pub - last_pub) * 1000 / STATS_INTERVAL_MS << "/s)"
+                 << " deliveries=" << metrics.total(&ThreadMetrics::deliveries)
+                 << " bytes-in=" << metrics.total(&ThreadMetrics::bytes_in)
+                 << " bytes-out=" << metrics.total(&ThreadMetrics::bytes_out) << endl;
+        if (o + n + d + u != last_drop)
+            cout << "Slow subscribers: dropped-oldest=" << o << " dropped-newest=" << n
+                 << " disconnected=" << d << " udp-dropped=" << u << endl;
+        last_pub = pub;
+        last_drop = o + n + d + u;
+    });
+
+    cout << "Server listening on TCP/UDP port " << PORT << " (" << loops_n
+         << " event loops" << (pin ? " pinned" : "") << ", " << listeners.size()
+         << (reuseport ? " SO_REUSEPORT listeners" : " listener") << ", backlog " << backlog << ")" << endl;
+    if (metrics_port) cout << "Metrics on http://0.0.0.0:" << metrics_port << "/metrics" << endl;
+    if (cluster_self >= 0)
+        cout << "Cluster node " << node_id << " of " << cluster_nodes.size() << endl;
+
+    for (auto& l : loops) l->start();
+    for (auto& l : loops) l->join();
 
-    closesocket(serverSock);
-    WSACleanup();
+    for (auto& l : listeners) close_socket(l->sock);
+    if (metrics_port) close_socket(metrics_listener.sock);
+    close_socket(udp_sock);
+    net_cleanup();
     return 0;
 }
@@ -0,0 +1,216 @@
+// server_metrics.h — Per-thread counters and histograms for the server's hot path
+// Every thread that handles traffic owns one ThreadMetrics and is its only
+// writer, so recording is a relaxed load and store on a cache line no other
+// writer touches, with no locked instruction. Readers (the stats timer, the
+// Prometheus endpoint) sum all threads' values with relaxed loads; a total
+// may be a moment stale but never torn.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define METRIC_BUCKETS 48   // log2 buckets: bucket i counts values <= 2^i
+
+class MetricCounter {
+public:
+    void add(uint64_t n = 1) { v_.store(v_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t get() const { return v_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<uint64_t> v_{0};
+};
+
+// Power-of-two buckets, which map straight onto Prometheus `le` bounds.
+class Log2Histogram {
+public:
+    void record(uint64_t v) {
+        size_t i = v <= 1 ? 0 : (size_t)msb(v - 1) + 1;
+        if (i >= METRIC_BUCKETS) i = METRIC_BUCKETS - 1;
+        buckets_[i].add();
+        sum_.add(v);
+    }
+
+    uint64_t bucket(size_t i) const { return buckets_[i].get(); }
+    uint64_t sum() const { return sum_.get(); }
+
+private:
+    static int msb(uint64_t v) {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanReverse64(&i, v);
+        return (int)i;
+#else
+        return 63 - __builtin_clzll(v);
+#endif
+    }
+
+    MetricCounter buckets_[METRIC_BUCKETS];
+    MetricCounter sum_;
+};
+
+// Times one phase into a histogram, in nanoseconds.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Log2Histogram& h) : h_(h), start_(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() {
+        h_.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+private:
+    Log2Histogram& h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+struct alignas(64) ThreadMetrics {
+    MetricCounter tcp_publishes, udp_publishes;
+    MetricCounter deliveries;               // frames handed to subscribers
+    MetricCounter replayed;                 // retained frames replayed on SUBSCRIBE
+    MetricCounter retransmits;              // frames resent for UDP NACKs
+    MetricCounter bytes_in, bytes_out;      // TCP and UDP payload on the wire
+    MetricCounter dropped_oldest, dropped_newest, slow_disconnects, udp_dropped;
+    MetricCounter tcp_opened, tcp_closed, idle_timeouts;
+    MetricCounter zerocopy_sends, zerocopy_copied;  // MSG_ZEROCOPY calls; those the kernel copied anyway
+    MetricCounter compressed, compress_saved;       // compressed MSG frames built; bytes they saved
+    MetricCounter forwarded, forward_dropped;       // publishes sent to their owner node; dropped, link backed up
+    MetricCounter relayed;                  // messages received from owner nodes
+    Log2Histogram fanout;                   // subscribers per publish
+    Log2Histogram queue_depth;              // subscriber's queue after each push
+    Log2Histogram recv_ns, dispatch_ns, flush_ns;   // Conn::on_ready phases
+};
+
+// Owns every thread's ThreadMetrics. Threads register once, on first use;
+// the blocks live as long as the process, so readers never race a free.
+class MetricsRegistry {
+public:
+    ThreadMetrics& local() {
+        thread_local ThreadMetrics* m = nullptr;
+        if (!m) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            all_.push_back(std::unique_ptr<ThreadMetrics>(new ThreadMetrics));
+            m = all_.back().get();
+        }
+        return *m;
+    }
+
+    // Sum of one counter over all threads.
+    uint64_t total(MetricCounter ThreadMetrics::*c) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return sum(c);
+    }
+
+    // Prometheus text exposition format, version 0.0.4.
+    std::string render() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::string out;
+        counter(out, "pubsub_publishes_total", "Publishes received.", "transport=\"tcp\"",
+                &ThreadMetrics::tcp_publishes);
+        sample(out, "pubsub_publishes_total", "transport=\"udp\"", sum(&ThreadMetrics::udp_publishes));
+        counter(out, "pubsub_deliveries_total", "Frames handed to subscribers.", "", &ThreadMetrics::deliveries);
+        counter(out, "pubsub_replayed_total", "Retained messages replayed to new subscribers.", "",
+                &ThreadMetrics::replayed);
+        counter(out, "pubsub_retransmits_total", "Messages resent for UDP NACKs.", "",
+                &ThreadMetrics::retransmits);
+        counter(out, "pubsub_bytes_in_total", "Bytes received from clients.", "", &ThreadMetrics::bytes_in);
+        counter(out, "pubsub_bytes_out_total", "Bytes sent to clients.", "", &ThreadMetrics::bytes_out);
+        counter(out, "pubsub_dropped_total", "Frames dropped for slow subscribers.", "reason=\"oldest\"",
+                &ThreadMetrics::dropped_oldest);
+        sample(out, "pubsub_dropped_total", "reason=\"newest\"", sum(&ThreadMetrics::dropped_newest));
+        sample(out, "pubsub_dropped_total", "reason=\"udp\"", sum(&ThreadMetrics::udp_dropped));
+        counter(out, "pubsub_slow_disconnects_total", "Subscribers disconnected for overflowing their queue.", "",
+                &ThreadMetrics::slow_disconnects);
+        counter(out, "pubsub_idle_timeouts_total", "Clients dropped by --idle-timeout.", "",
+                &ThreadMetrics::idle_timeouts);
+        counter(out, "pubsub_zerocopy_sends_total", "MSG_ZEROCOPY sends of large frames.", "",
+                &ThreadMetrics::zerocopy_sends);
+        counter(out, "pubsub_zerocopy_copied_total", "Zerocopy sends the kernel completed by copying.", "",
+                &ThreadMetrics::zerocopy_copied);
+        counter(out, "pubsub_compressed_total", "Compressed MSG frames built (once per message and form).", "",
+                &ThreadMetrics::compressed);
+        counter(out, "pubsub_compress_saved_bytes_total", "Bytes compression saved over the raw frames built.", "",
+                &ThreadMetrics::compress_saved);
+        counter(out, "pubsub_forwarded_total", "Publishes forwarded to the topic's owner node.", "",
+                &ThreadMetrics::forwarded);
+        counter(out, "pubsub_forward_dropped_total", "Publishes dropped because the owner's link was backed up.", "",
+                &ThreadMetrics::forward_dropped);
+        counter(out, "pubsub_relayed_total", "Messages received from owner nodes for local subscribers.", "",
+                &ThreadMetrics::relayed);
+        header(out, "pubsub_tcp_connections", "Open TCP connections.", "gauge");
+        sample(out, "pubsub_tcp_connections", "",
+               sum(&ThreadMetrics::tcp_opened) - sum(&ThreadMetrics::tcp_closed));
+        histogram(out, "pubsub_fanout_subscribers", "Subscribers reached per publish.", "",
+                  &ThreadMetrics::fanout, 0, 17, 1.0);
+        histogram(out, "pubsub_queue_depth", "Subscriber queue depth after each push.", "",
+                  &ThreadMetrics::queue_depth, 0, 20, 1.0);
+        histogram(out, "pubsub_handle_seconds", "Time spent per connection phase.", "phase=\"recv\"",
+                  &ThreadMetrics::recv_ns, 7, 30, 1e-9);
+        histogram(out, nullptr, nullptr, "phase=\"dispatch\"", &ThreadMetrics::dispatch_ns, 7, 30, 1e-9);
+        histogram(out, nullptr, nullptr, "phase=\"flush\"", &ThreadMetrics::flush_ns, 7, 30, 1e-9);
+        return out;
+    }
+
+private:
+    uint64_t sum(MetricCounter ThreadMetrics::*c) const {
+        uint64_t n = 0;
+        for (auto& m : all_) n += ((*m).*c).get();
+        return n;
+    }
+
+    static void header(std::string& out, const char* name, const char* help, const char* type) {
+        out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+        out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+    }
+
+    static void sample(std::string& out, const char* name, const char* labels, double v) {
+        char line[256];
+        snprintf(line, sizeof(line), *labels ? "%s{%s} %.15g\n" : "%s%s %.15g\n", name, labels, v);
+        out += line;
+    }
+
+    void counter(std::string& out, const char* name, const char* help, const char* labels,
+                 MetricCounter ThreadMetrics::*c) {
+        header(out, name, help, "counter");
+        sample(out, name, labels, (double)sum(c));
+    }
+
+    // Buckets 2^lo .. 2^hi in the output, everything larger under +Inf;
+    // `scale` converts recorded units to exported ones. A null name continues
+    // the previous histogram with another label set.
+    void histogram(std::string& out, const char* name, const char* help, const char* labels,
+                   Log2Histogram ThreadMetrics::*h, int lo, int hi, double scale) {
+        if (name) {
+            header(out, name, help, "histogram");
+            hist_name_ = name;
+        }
+        uint64_t buckets[METRIC_BUCKETS] = {}, total_sum = 0;
+        for (auto& m : all_) {
+            const Log2Histogram& x = (*m).*h;
+            for (size_t i = 0; i < METRIC_BUCKETS; ++i) buckets[i] += x.bucket(i);
+            total_sum += x.sum();
+        }
+        std::string sep = *labels ? std::string(labels) + "," : std::string();
+        uint64_t cum = 0;
+        for (int i = 0; i < METRIC_BUCKETS; ++i) {
+            cum += buckets[i];
+            if (i < lo || i > hi) continue;
+            char le[64];
+            snprintf(le, sizeof(le), "le=\"%.9g\"", (double)(1ull << i) * scale);
+            sample(out, (hist_name_ + "_bucket").c_str(), (sep + le).c_str(), (double)cum);
+        }
+        sample(out, (hist_name_ + "_bucket").c_str(), (sep + "le=\"+Inf\"").c_str(), (double)cum);
+        sample(out, (hist_name_ + "_sum").c_str(), labels, (double)total_sum * scale);
+        sample(out, (hist_name_ + "_count").c_str(), labels, (double)cum);
+    }
+
+    std::mutex mtx_;
+    std::vector<std::unique_ptr<ThreadMetrics>> all_;
+    std::string hist_name_;     // histogram being rendered
+};
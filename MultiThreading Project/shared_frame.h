@@ -0,0 +1,69 @@
+// shared_frame.h — Reference-counted, immutable encoded frame
+// A publish is encoded once into a single heap block (refcount + bytes);
+// every subscriber queue holds a FrameRef to that block until it has been
+// written, so fan-out to N subscribers costs one allocation, and that one
+// is usually a block recycled through the thread's SlabPool.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+#include "protocol.h"
+#include "slab_pool.h"
+
+class FrameRef {
+public:
+    FrameRef() = default;
+    FrameRef(const FrameRef& o) : b_(o.b_) { if (b_) b_->refs.fetch_add(1, std::memory_order_relaxed); }
+    FrameRef(FrameRef&& o) noexcept : b_(o.b_) { o.b_ = nullptr; }
+    FrameRef& operator=(FrameRef o) noexcept { std::swap(b_, o.b_); return *this; }
+    ~FrameRef() { release(); }
+
+    // Uninitialized frame of `size` bytes for the caller to fill in.
+    static FrameRef alloc(size_t size) {
+        uint8_t cls;
+        void* mem = SlabPool::acquire(sizeof(Block) + size, cls);
+        FrameRef f;
+        f.b_ = new (mem) Block;
+        f.b_->size = size;
+        f.b_->cls = cls;
+        return f;
+    }
+
+    static FrameRef encode(int type, std::string_view topic, std::string_view payload, uint64_t seq = 0) {
+        FrameRef f = alloc(frame_size(topic.size(), payload.size(), type));
+        char* p = write_head(f.data(), type, topic.size(), payload.size(), seq);
+        if (!topic.empty()) memcpy(p, topic.data(), topic.size());
+        if (!payload.empty()) memcpy(p + topic.size(), payload.data(), payload.size());
+        return f;
+    }
+
+    // Drops trailing bytes of a frame that was allocated for its worst case.
+    // Only valid before the frame is shared.
+    void shrink(size_t size) { if (size < b_->size) b_->size = size; }
+
+    char* data() const { return (char*)(b_ + 1); }
+    size_t size() const { return b_ ? b_->size : 0; }
+    explicit operator bool() const { return b_ != nullptr; }
+
+private:
+    struct Block {
+        std::atomic<uint32_t> refs{1};
+        uint8_t cls = POOL_NONE;    // SlabPool class to return the block to
+        size_t size = 0;
+    };
+
+    void release() {
+        if (b_ && b_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            uint8_t cls = b_->cls;
+            b_->~Block();
+            SlabPool::release(b_, cls);
+        }
+        b_ = nullptr;
+    }
+
+    Block* b_ = nullptr;
+};
@@ -0,0 +1,133 @@
+// slab_pool.h — Per-thread size-class pool for frames and connection state
+// Blocks are grouped into power-of-two size classes and recycled through
+// thread-local freelists, so the steady state of a busy server allocates and
+// frees frames without touching the general heap or any shared lock. A block
+// freed on another thread than the one that allocated it simply joins the
+// freeing thread's list; each list is capped, and blocks beyond the cap (and
+// requests larger than the largest class) go back to operator new/delete.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#define POOL_MIN_SHIFT   6                  // smallest class: 64 bytes
+#define POOL_CLASSES     12                 // up to 64 << 11 = 128 KiB
+#define POOL_CACHE_BYTES (2u << 20)         // per class, per thread
+#define POOL_NONE        0xff               // class of a block from the general heap
+
+class SlabPool {
+public:
+    // Returns at least `n` bytes and the class to pass back to release().
+    static void* acquire(size_t n, uint8_t& cls) {
+        cls = class_of(n);
+        if (cls == POOL_NONE) return ::operator new(n);
+        Cache& c = cache();
+        if (FreeBlock* b = c.head[cls]) {
+            c.head[cls] = b->next;
+            c.count[cls]--;
+            return b;
+        }
+        return ::operator new(class_size(cls));
+    }
+
+    static void release(void* p, uint8_t cls) {
+        if (cls == POOL_NONE) { ::operator delete(p); return; }
+        Cache& c = cache();
+        if (c.closed || c.count[cls] >= POOL_CACHE_BYTES / class_size(cls)) {
+            ::operator delete(p);
+            return;
+        }
+        FreeBlock* b = (FreeBlock*)p;
+        b->next = c.head[cls];
+        c.head[cls] = b;
+        c.count[cls]++;
+    }
+
+    static uint8_t class_of(size_t n) {
+        size_t sz = (size_t)1 << POOL_MIN_SHIFT;
+        for (uint8_t i = 0; i < POOL_CLASSES; ++i, sz <<= 1)
+            if (n <= sz) return i;
+        return POOL_NONE;
+    }
+
+    static size_t class_size(uint8_t cls) { return (size_t)1 << (POOL_MIN_SHIFT + cls); }
+
+private:
+    struct FreeBlock { FreeBlock* next; };
+
+    // Trivially destructible so it stays usable for frees that happen after
+    // the thread's destructors ran (e.g. statics torn down at exit); Reaper
+    // empties it and marks it closed, after which frees go to the heap.
+    struct Cache {
+        FreeBlock* head[POOL_CLASSES];
+        uint32_t count[POOL_CLASSES];
+        bool closed;
+    };
+
+    struct Reaper {
+        ~Reaper() {
+            Cache& c = cache_storage();
+            c.closed = true;
+            for (auto& h : c.head) {
+                while (FreeBlock* b = h) {
+                    h = b->next;
+                    ::operator delete(b);
+                }
+            }
+        }
+    };
+
+    static Cache& cache_storage() {
+        thread_local Cache c{};
+        return c;
+    }
+
+    static Cache& cache() {
+        thread_local Reaper reaper;     // constructed on first use, destroyed at thread exit
+        (void)reaper;
+        return cache_storage();
+    }
+};
+
+// Standard allocator over SlabPool, for allocate_shared and containers.
+// Each allocation records its class in a small header in front of it.
+template <class T>
+struct SlabAllocator {
+    typedef T value_type;
+
+    SlabAllocator() = default;
+    template <class U> SlabAllocator(const SlabAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= kHeader, "over-aligned types need their own pool");
+        uint8_t cls;
+        char* p = (char*)SlabPool::acquire(kHeader + n * sizeof(T), cls);
+        *(uint8_t*)p = cls;
+        return (T*)(p + kHeader);
+    }
+
+    void deallocate(T* p, size_t) {
+        char* base = (char*)p - kHeader;
+        SlabPool::release(base, *(uint8_t*)base);
+    }
+
+    // Default-initializes trivial types: resizing a receive buffer does not
+    // zero the bytes recv() is about to overwrite.
+    template <class U, class... Args>
+    void construct(U* p, Args&&... args) {
+        if constexpr (sizeof...(Args) == 0 && std::is_trivially_default_constructible<U>::value)
+            ::new ((void*)p) U;
+        else
+            ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template <class U> bool operator==(const SlabAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const SlabAllocator<U>&) const { return false; }
+
+private:
+    static constexpr size_t kHeader = alignof(std::max_align_t);
+};
@@ -0,0 +1,74 @@
+// slot_table.h — Generation-tagged slot table
+// Objects are registered in a dense array of slots and addressed by a SlotId
+// (index + generation). Insert and remove are O(1) through a freelist of
+// slot indices; removing bumps the slot's generation, so an id kept past its
+// object's removal never resolves to whatever later reuses the slot.
+// Not synchronized: one owner thread per table.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct SlotId {
+    uint32_t index = UINT32_MAX;
+    uint32_t gen = 0;
+    bool valid() const { return index != UINT32_MAX; }
+};
+
+template <class T>
+class SlotTable {
+public:
+    SlotId insert(T* p) {
+        uint32_t i;
+        if (free_ != UINT32_MAX) {
+            i = free_;
+            free_ = slots_[i].next_free;
+        }
+        else {
+            i = (uint32_t)slots_.size();
+            slots_.push_back({});
+        }
+        slots_[i].p = p;
+        ++live_;
+        return {i, slots_[i].gen};
+    }
+
+    // False when `id` is stale or was never issued.
+    bool remove(SlotId id) {
+        if (!get(id)) return false;
+        Slot& s = slots_[id.index];
+        s.p = nullptr;
+        s.gen++;
+        s.next_free = free_;
+        free_ = id.index;
+        --live_;
+        return true;
+    }
+
+    T* get(SlotId id) const {
+        if (id.index >= slots_.size()) return nullptr;
+        const Slot& s = slots_[id.index];
+        return s.gen == id.gen ? s.p : nullptr;
+    }
+
+    size_t size() const { return live_; }
+
+    // Calls fn(T*) for every live object. fn may remove the object it is
+    // given (and only that one).
+    template <class Fn>
+    void for_each(Fn&& fn) {
+        for (size_t i = 0; i < slots_.size(); ++i)
+            if (T* p = slots_[i].p) fn(p);
+    }
+
+private:
+    struct Slot {
+        T* p = nullptr;
+        uint32_t gen = 0;
+        uint32_t next_free = UINT32_MAX;
+    };
+
+    std::vector<Slot> slots_;
+    uint32_t free_ = UINT32_MAX;
+    size_t live_ = 0;
+};
@@ -0,0 +1,88 @@
+// topic_codec.h — Per-topic payload compression state on the server
+// A topic mapped to a codec (--compress) keeps one TopicCodec. LZ4 needs no
+// state. zstd starts without a dictionary and samples the first payloads it
+// compresses; once ZSTD_TRAIN_BYTES or ZSTD_TRAIN_MSGS of them are in, the
+// codec's own thread trains a dictionary on them, and from the moment it is
+// published every payload is compressed against it. Publishers never wait for
+// the training: until then they compress without a dictionary. Training
+// happens once: the dictionary is never replaced, so a connection is sent
+// each one at most once and a Dictionary* stays valid as long as the topic.
+//
+// Sampling takes a lock only until the sample set is complete, and publishers
+// that find it held do not wait: their payload is simply not sampled.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "payload_codec.h"
+#include "shared_frame.h"
+
+#define ZSTD_DICT_MAX    (16 << 10)     // trained dictionary size
+#define ZSTD_TRAIN_BYTES (1 << 20)      // samples collected before training...
+#define ZSTD_TRAIN_MSGS  4096           // ...or this many messages
+#define ZSTD_SAMPLE_MAX  (4 << 10)      // longer payloads contribute their first bytes
+
+class TopicCodec {
+public:
+    // A trained dictionary and its TYPE_DICT frame, as sent to subscribers.
+    struct Dictionary {
+        ZstdDictionary zstd;
+        FrameRef frame;
+        Dictionary(std::string bytes, std::string_view topic)
+            : zstd(std::move(bytes), ZstdDictionary::Compress),
+              frame(FrameRef::encode(TYPE_DICT, topic, zstd.bytes())) {}
+    };
+
+    // `codec` is FLAG_LZ4 or FLAG_ZSTD, and built in.
+    explicit TopicCodec(int codec) : codec(codec) {}
+
+    ~TopicCodec() {
+        if (trainer_.joinable()) trainer_.join();
+    }
+
+    TopicCodec(const TopicCodec&) = delete;
+    TopicCodec& operator=(const TopicCodec&) = delete;
+
+    const int codec;
+
+    // The dictionary to compress with; null until one has been trained.
+    const Dictionary* dict() const { return dict_.load(std::memory_order_acquire); }
+
+    // Offers one raw payload of `topic` to dictionary training (zstd only).
+    void sample(std::string_view topic, std::string_view payload) {
+        if (codec != FLAG_ZSTD || done_.load(std::memory_order_relaxed)) return;
+        std::unique_lock<std::mutex> lock(mtx_, std::try_to_lock);
+        if (!lock || done_.load(std::memory_order_relaxed) || payload.empty()) return;
+        size_t n = std::min(payload.size(), (size_t)ZSTD_SAMPLE_MAX);
+        samples_.append(payload.data(), n);
+        sizes_.push_back(n);
+        if (samples_.size() < ZSTD_TRAIN_BYTES && sizes_.size() < ZSTD_TRAIN_MSGS) return;
+        done_.store(true, std::memory_order_relaxed);
+        trainer_ = std::thread([this, samples = std::move(samples_), sizes = std::move(sizes_),
+                                name = std::string(topic)] {
+            std::string bytes = train_dictionary(samples, sizes, ZSTD_DICT_MAX);
+            // A failed training is not retried: the topic stays dictionary-less.
+            if (bytes.empty()) return;
+            owned_.reset(new Dictionary(std::move(bytes), name));
+            if (owned_->zstd.id()) dict_.store(owned_.get(), std::memory_order_release);
+        });
+    }
+
+private:
+    std::mutex mtx_;
+    std::string samples_;
+    std::vector<size_t> sizes_;
+    std::atomic<bool> done_{false};
+    std::thread trainer_;
+    std::unique_ptr<Dictionary> owned_;     // written by trainer_ only
+    std::atomic<const Dictionary*> dict_{nullptr};
+};
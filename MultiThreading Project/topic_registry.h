@@ -0,0 +1,222 @@
+// topic_registry.h — Interned topics mapped to compact subscriber lists
+// Every topic name is interned once into a TopicId. Each topic keeps a dense
+// array of subscribers and each subscriber keeps the topics it is on; the two
+// sides point at each other's slots so both insert and remove are swap-and-pop.
+//
+// That master copy is only touched by writers (under the caller's lock).
+// Publishers read an immutable SubscriberList snapshot instead, without any
+// lock; publish() swaps in a fresh snapshot and retires the old one through
+// an EpochDomain, so readers must hold an EpochDomain::Guard while using it.
+//
+// A name with a `*` or `#` level is a pattern (see topic_trie.h). It is a
+// topic like any other on the writer side; publishers reach its subscribers
+// through route(), the union of a topic's own snapshot and those of every
+// pattern that matches it, cached per published topic until either side
+// changes.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "epoch.h"
+#include "retained_ring.h"
+#include "topic_codec.h"
+#include "topic_trie.h"
+
+typedef uint32_t TopicId;
+
+struct Subscriber {
+    struct Subscription {
+        TopicId topic;
+        uint32_t slot;          // index in that topic's subscriber array
+    };
+    std::vector<Subscription> subscriptions;
+    int kind = 0;               // owner-defined tag, e.g. the transport
+    std::atomic<int> caps{0};   // owner-defined capability bits, read by publishers
+};
+
+struct SubscriberList {
+    std::vector<Subscriber*> subs;
+};
+
+class TopicRegistry {
+public:
+    struct Entry {
+        Subscriber* sub;
+        uint32_t back;          // index in sub->subscriptions
+    };
+
+    // A topic's subscribers merged with those of the patterns matching it,
+    // valid while neither the topic's version nor the pattern generation moves.
+    struct Route {
+        uint64_t version, patterns;
+        std::unique_ptr<SubscriberList> merged;     // null: no pattern adds anyone
+    };
+
+    // Topics are never destroyed, so a Topic* stays valid for the life of the
+    // registry and can be cached by readers.
+    struct Topic {
+        TopicId id;
+        std::string name;
+        std::vector<Entry> subs;                        // master, writers only
+        std::atomic<const SubscriberList*> snapshot;    // readers
+        bool pattern = false;
+        std::atomic<uint64_t> version{0};               // bumped by every publish()
+        std::atomic<const Route*> route{nullptr};
+        std::atomic<uint64_t> last_seq{0};              // seq of the newest message
+        std::unique_ptr<RetainedRing> retained{};       // owner-set under the writers' lock, before first use
+        std::unique_ptr<TopicCodec> codec{};            // likewise; null: sent uncompressed
+    };
+
+    explicit TopicRegistry(EpochDomain& epoch) : epoch_(epoch) {}
+
+    ~TopicRegistry() {
+        for (auto& t : topics_) {
+            delete t->snapshot.load();
+            delete t->route.load();
+        }
+    }
+
+    // Returns the topic for `name`, creating it on first use.
+    Topic* intern(std::string_view name) {
+        auto it = ids_.find(name);
+        if (it != ids_.end()) return topics_[it->second].get();
+        TopicId id = (TopicId)topics_.size();
+        topics_.push_back(std::unique_ptr<Topic>(new Topic{id, std::string(name), {}, {new SubscriberList}}));
+        Topic* t = topics_.back().get();
+        ids_.emplace(t->name, id);     // key views the stable Topic::name
+        if (TopicTrie::is_pattern(t->name)) {
+            t->pattern = true;
+            trie_.insert(t->name, id);
+            pattern_gen_.fetch_add(1, std::memory_order_release);
+        }
+        return t;
+    }
+
+    Topic* find(std::string_view name) const {
+        auto it = ids_.find(name);
+        return it == ids_.end() ? nullptr : topics_[it->second].get();
+    }
+
+    Topic* topic(TopicId id) const { return topics_[id].get(); }
+    size_t topic_count() const { return topics_.size(); }
+
+    // Both calls are O(1) in the topic's population; the duplicate check scans
+    // only the subscriber's own (short) topic list. Return false on a no-op.
+    // Neither is visible to readers until publish() is called for the topic.
+    bool subscribe(Subscriber* s, TopicId id) {
+        if (index_of(s, id) >= 0) return false;
+        auto& subs = topics_[id]->subs;
+        s->subscriptions.push_back({id, (uint32_t)subs.size()});
+        subs.push_back({s, (uint32_t)s->subscriptions.size() - 1});
+        return true;
+    }
+
+    bool unsubscribe(Subscriber* s, TopicId id) {
+        int i = index_of(s, id);
+        if (i < 0) return false;
+        remove_at(s, (uint32_t)i);
+        return true;
+    }
+
+    // Calls touched(TopicId) for every topic `s` leaves.
+    template <class Fn>
+    void unsubscribe_all(Subscriber* s, Fn&& touched) {
+        while (!s->subscriptions.empty()) {
+            uint32_t i = (uint32_t)s->subscriptions.size() - 1;
+            TopicId id = s->subscriptions[i].topic;
+            remove_at(s, i);
+            touched(id);
+        }
+    }
+
+    // Copies the master list into a new snapshot. O(subscribers of the topic),
+    // so callers batch several changes to a topic before publishing it.
+    void publish(TopicId id) {
+        Topic& t = *topics_[id];
+        SubscriberList* next = new SubscriberList;
+        next->subs.reserve(t.subs.size());
+        for (auto& e : t.subs) next->subs.push_back(e.sub);
+        // Version first: a reader that sees the new snapshot sees it too.
+        t.version.fetch_add(1, std::memory_order_release);
+        const SubscriberList* prev = t.snapshot.exchange(next, std::memory_order_acq_rel);
+        if (t.pattern) pattern_gen_.fetch_add(1, std::memory_order_release);
+        epoch_.retire(const_cast<SubscriberList*>(prev));
+    }
+
+    // Lock-free, under an EpochDomain::Guard: everyone a publish on `t`
+    // reaches, each subscriber once. Returns nullptr when the cached route is
+    // out of date; the caller then takes its lock and calls route().
+    const SubscriberList* cached_route(const Topic* t) const {
+        const SubscriberList* own = t->snapshot.load(std::memory_order_acquire);
+        uint64_t gen = pattern_gen_.load(std::memory_order_acquire);
+        if (!gen) return own;                       // no pattern was ever subscribed
+        const Route* r = t->route.load(std::memory_order_acquire);
+        if (!r || r->version != t->version.load(std::memory_order_acquire) || r->patterns != gen) return nullptr;
+        return r->merged ? r->merged.get() : own;
+    }
+
+    // Same, rebuilding the cached route if needed. Caller holds the writers'
+    // lock and an EpochDomain::Guard.
+    const SubscriberList* route(Topic* t) {
+        const SubscriberList* own = t->snapshot.load(std::memory_order_acquire);
+        uint64_t v = t->version.load(std::memory_order_relaxed);
+        uint64_t gen = pattern_gen_.load(std::memory_order_relaxed);
+        if (!gen) return own;
+        const Route* cur = t->route.load(std::memory_order_acquire);
+        if (cur && cur->version == v && cur->patterns == gen) return cur->merged ? cur->merged.get() : own;
+
+        Route* next = new Route{v, gen, nullptr};
+        trie_.match(t->name, matched_);
+        std::unordered_set<Subscriber*> seen(own->subs.begin(), own->subs.end());
+        std::vector<Subscriber*> all(own->subs);
+        for (uint32_t id : matched_) {
+            if (id == t->id) continue;
+            for (Subscriber* s : topics_[id]->snapshot.load(std::memory_order_acquire)->subs)
+                if (seen.insert(s).second) all.push_back(s);
+        }
+        if (all.size() != own->subs.size()) next->merged.reset(new SubscriberList{std::move(all)});
+        const Route* prev = t->route.exchange(next, std::memory_order_acq_rel);
+        if (prev) epoch_.retire(const_cast<Route*>(prev));
+        return next->merged ? next->merged.get() : own;
+    }
+
+private:
+    static int index_of(const Subscriber* s, TopicId id) {
+        for (size_t i = 0; i < s->subscriptions.size(); ++i)
+            if (s->subscriptions[i].topic == id) return (int)i;
+        return -1;
+    }
+
+    void remove_at(Subscriber* s, uint32_t i) {
+        Subscriber::Subscription gone = s->subscriptions[i];
+        auto& subs = topics_[gone.topic]->subs;
+
+        // Fill the hole in the topic's array with its last entry.
+        Entry last = subs.back();
+        subs[gone.slot] = last;
+        last.sub->subscriptions[last.back].slot = gone.slot;
+        subs.pop_back();
+
+        // Same on the subscriber's side.
+        if (i + 1 != s->subscriptions.size()) {
+            Subscriber::Subscription tail = s->subscriptions.back();
+            s->subscriptions[i] = tail;
+            topics_[tail.topic]->subs[tail.slot].back = i;
+        }
+        s->subscriptions.pop_back();
+    }
+
+    EpochDomain& epoch_;
+    std::unordered_map<std::string_view, TopicId> ids_;
+    std::vector<std::unique_ptr<Topic>> topics_;
+    TopicTrie trie_;
+    std::atomic<uint64_t> pattern_gen_{0};      // bumped when any pattern's subscribers change
+    std::vector<uint32_t> matched_;             // route() scratch
+};
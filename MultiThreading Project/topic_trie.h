@@ -0,0 +1,99 @@
+// topic_trie.h — Wildcard subscription patterns indexed by topic level
+// Topics are dot-separated levels ("md.eq.AAPL"). A pattern level may be a
+// literal, `*` (exactly one level) or `#` (zero or more levels), so
+// "md.*.AAPL" and "md.#" both match "md.eq.AAPL". Each trie edge is a whole
+// level, and a match walks one path per wildcard branch: the cost follows
+// the topic's depth and the wildcards on its path, not the number of patterns.
+// Not synchronized: the owner serializes insert() and match().
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class TopicTrie {
+public:
+    static bool is_pattern(std::string_view topic) {
+        bool wild = false;
+        for_levels(topic, [&](std::string_view level) { wild |= level == "*" || level == "#"; });
+        return wild;
+    }
+
+    // Registers `id` under `pattern`; a pattern is inserted once. Runs of
+    // `#` collapse into one, which matches the same topics.
+    void insert(std::string_view pattern, uint32_t id) {
+        Node* n = &root_;
+        bool after_hash = false;
+        for_levels(pattern, [&](std::string_view level) {
+            if (level == "#" && after_hash) return;
+            after_hash = level == "#";
+            std::unique_ptr<Node>* slot;
+            if (level == "*") slot = &n->star;
+            else if (level == "#") slot = &n->hash;
+            else {
+                auto it = n->kids.find(level);
+                if (it != n->kids.end()) { n = it->second.get(); return; }
+                Node* k = new Node;
+                k->level = std::string(level);
+                n->kids.emplace(k->level, std::unique_ptr<Node>(k));   // key views k->level
+                n = k;
+                return;
+            }
+            if (!*slot) slot->reset(new Node);
+            n = slot->get();
+        });
+        n->ids.push_back(id);
+        ++size_;
+    }
+
+    // Ids of every pattern that matches `topic`, each once.
+    void match(std::string_view topic, std::vector<uint32_t>& out) const {
+        std::vector<std::string_view> levels;
+        for_levels(topic, [&](std::string_view level) { levels.push_back(level); });
+        out.clear();
+        walk(&root_, levels, 0, out);
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    struct Node {
+        std::string level;
+        std::unordered_map<std::string_view, std::unique_ptr<Node>> kids;
+        std::unique_ptr<Node> star, hash;
+        std::vector<uint32_t> ids;      // patterns ending here
+    };
+
+    template <class Fn>
+    static void for_levels(std::string_view s, Fn&& fn) {
+        size_t at = 0;
+        while (true) {
+            size_t dot = s.find('.', at);
+            if (dot == std::string_view::npos) { fn(s.substr(at)); return; }
+            fn(s.substr(at, dot - at));
+            at = dot + 1;
+        }
+    }
+
+    static void walk(const Node* n, const std::vector<std::string_view>& levels, size_t i,
+                     std::vector<uint32_t>& out) {
+        if (n->hash)
+            for (size_t k = i; k <= levels.size(); ++k) walk(n->hash.get(), levels, k, out);
+        if (i == levels.size()) {
+            out.insert(out.end(), n->ids.begin(), n->ids.end());
+            return;
+        }
+        auto it = n->kids.find(levels[i]);
+        if (it != n->kids.end()) walk(it->second.get(), levels, i + 1, out);
+        if (n->star) walk(n->star.get(), levels, i + 1, out);
+    }
+
+    Node root_;
+    size_t size_ = 0;
+};
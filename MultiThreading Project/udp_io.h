@@ -0,0 +1,135 @@
+// udp_io.h — Batched datagram I/O for the server's UDP transport
+// On Linux one recvmmsg/sendmmsg call moves up to a whole batch of datagrams;
+// elsewhere the same interface falls back to one recvfrom/sendto per datagram.
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "net.h"
+
+#define UDP_BATCH        32
+#define UDP_MAX_DATAGRAM 65536
+
+struct Datagram {
+    const char* data;
+    size_t len;
+    sockaddr_in from;
+};
+
+// Owns UDP_BATCH receive buffers; recv_batch() refills them.
+class UdpReceiver {
+public:
+    UdpReceiver() : buf_(UDP_BATCH * (size_t)UDP_MAX_DATAGRAM) {}
+
+    // Returns the datagrams read by one batch, empty once the socket is drained.
+    // Datagrams truncated by the buffer are dropped.
+    const std::vector<Datagram>& recv_batch(sock_t s) {
+        got_.clear();
+#ifdef __linux__
+        mmsghdr hdr[UDP_BATCH];
+        iovec iov[UDP_BATCH];
+        sockaddr_in from[UDP_BATCH];
+        memset(hdr, 0, sizeof(hdr));
+        for (int i = 0; i < UDP_BATCH; ++i) {
+            iov[i].iov_base = slot(i);
+            iov[i].iov_len = UDP_MAX_DATAGRAM;
+            hdr[i].msg_hdr.msg_iov = &iov[i];
+            hdr[i].msg_hdr.msg_iovlen = 1;
+            hdr[i].msg_hdr.msg_name = &from[i];
+            hdr[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+        int n = recvmmsg(s, hdr, UDP_BATCH, MSG_DONTWAIT, nullptr);
+        for (int i = 0; i < n; ++i) {
+            if (hdr[i].msg_hdr.msg_flags & MSG_TRUNC) continue;
+            got_.push_back({slot(i), hdr[i].msg_len, from[i]});
+        }
+#else
+        for (int i = 0; i < UDP_BATCH; ++i) {
+            sockaddr_in from{};
+            socklen_t flen = sizeof(from);
+            int n = recvfrom(s, slot(i), UDP_MAX_DATAGRAM, 0, (sockaddr*)&from, &flen);
+            if (n < 0) break;
+            got_.push_back({slot(i), (size_t)n, from});
+        }
+#endif
+        return got_;
+    }
+
+private:
+    char* slot(int i) { return buf_.data() + (size_t)i * UDP_MAX_DATAGRAM; }
+
+    std::vector<char> buf_;
+    std::vector<Datagram> got_;
+};
+
+// Collects (destination, bytes) pairs and sends them UDP_BATCH at a time.
+// The bytes are not copied; they must stay valid until flush() returns.
+// UDP is the loss-tolerant path: datagrams the socket cannot take are dropped.
+class UdpSender {
+public:
+    explicit UdpSender(sock_t s) : s_(s) {}
+    ~UdpSender() { flush(); }
+
+    void add(const sockaddr_in& to, const char* p, size_t n) {
+        Pending& q = pending_[count_++];
+        q.to = to;
+        q.p = p;
+        q.n = n;
+        if (count_ == UDP_BATCH) flush();
+    }
+
+    // Returns the number of datagrams the kernel did not accept.
+    size_t flush() {
+        size_t dropped = 0;
+#ifdef __linux__
+        mmsghdr hdr[UDP_BATCH];
+        iovec iov[UDP_BATCH];
+        memset(hdr, 0, sizeof(hdr));
+        for (size_t i = 0; i < count_; ++i) {
+            iov[i].iov_base = (void*)pending_[i].p;
+            iov[i].iov_len = pending_[i].n;
+            hdr[i].msg_hdr.msg_iov = &iov[i];
+            hdr[i].msg_hdr.msg_iovlen = 1;
+            hdr[i].msg_hdr.msg_name = &pending_[i].to;
+            hdr[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        size_t done = 0;
+        while (done < count_) {
+            int n = sendmmsg(s_, hdr + done, (unsigned)(count_ - done), MSG_DONTWAIT);
+            if (n < 0) {
+                if (last_error_interrupted()) continue;
+                // Skip the datagram that failed and keep going with the rest.
+                ++dropped;
+                ++done;
+                continue;
+            }
+            done += (size_t)n;
+        }
+#else
+        for (size_t i = 0; i < count_; ++i) {
+            if (sendto(s_, pending_[i].p, (int)pending_[i].n, 0,
+                       (const sockaddr*)&pending_[i].to, sizeof(sockaddr_in)) < 0)
+                ++dropped;
+        }
+#endif
+        dropped_ += dropped;
+        count_ = 0;
+        return dropped;
+    }
+
+    size_t dropped() const { return dropped_; }
+
+private:
+    struct Pending {
+        sockaddr_in to;
+        const char* p;
+        size_t n;
+    };
+
+    sock_t s_;
+    Pending pending_[UDP_BATCH];
+    size_t count_ = 0;
+    size_t dropped_ = 0;
+};